@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "bootstrap.h"
+
+/* the resamples, and the bounds refitted to them */
+struct Bootstrap
+{
+    struct Calib *c;
+    int width;
+    int height;
+    bool swap_xy;
+
+    int num_resamples;
+    int num_threads;
+    XYinfo *axys;
+    bool *valid;
+};
+
+/* a worker: every num_threads-th resample, from 'first' on */
+struct Job
+{
+    struct Bootstrap *b;
+    int first;
+};
+
+/* xorshift, on 32 bits of an unsigned long */
+static unsigned long
+next_random (unsigned long *state)
+{
+    unsigned long x = *state;
+
+    x ^= (x << 13) & 0xffffffffUL;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xffffffffUL;
+    *state = x;
+    return x;
+}
+
+/* refit the calibration to resample 'i' of the clicks */
+static void
+resample (struct Bootstrap *b,
+          int               i)
+{
+    struct Calib r = *b->c;
+    unsigned long state = ((i + 1) * 2654435761UL) & 0xffffffffUL;
+    int n = b->c->num_clicks;
+    int k;
+
+    for (k = 0; k < n; k++)
+    {
+        int j = next_random(&state) % n;
+
+        r.clicked_x[k] = b->c->clicked_x[j];
+        r.clicked_y[k] = b->c->clicked_y[j];
+        r.point[k] = b->c->point[j];
+    }
+
+    b->valid[i] = fit_calibration(&r, b->width, b->height, b->swap_xy, &b->axys[i]);
+}
+
+static void*
+worker (void *data)
+{
+    struct Job *job = (struct Job*)data;
+    struct Bootstrap *b = job->b;
+    int i;
+
+    for (i = job->first; i < b->num_resamples; i += b->num_threads)
+        resample(b, i);
+
+    return NULL;
+}
+
+/* run the jobs on threads of their own (or here, if there are none) */
+static void
+run_jobs (struct Job *jobs,
+          int         num_jobs)
+{
+    int i;
+#ifdef HAVE_PTHREAD_H
+    pthread_t *threads = (pthread_t*)calloc(num_jobs, sizeof(pthread_t));
+    int started = 0;
+
+    if (threads != NULL)
+        while (started < num_jobs &&
+               pthread_create(&threads[started], NULL, worker, &jobs[started]) == 0)
+            started++;
+    for (i = started; i < num_jobs; i++)
+        worker(&jobs[i]);
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+#else
+    for (i = 0; i < num_jobs; i++)
+        worker(&jobs[i]);
+#endif
+}
+
+static int
+compare_int (const void *a,
+             const void *b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+/* the 2.5 and 97.5 percentiles of 'n' values (sorts them in place) */
+static void
+interval (int *v,
+          int  n,
+          int *low,
+          int *high)
+{
+    qsort(v, n, sizeof(int), compare_int);
+    *low = v[(int)(0.025 * (n - 1) + 0.5)];
+    *high = v[(int)(0.975 * (n - 1) + 0.5)];
+}
+
+bool
+bootstrap (struct Calib      *c,
+           int                width,
+           int                height,
+           int                num_resamples,
+           int                num_threads,
+           struct Confidence *conf)
+{
+    struct Bootstrap b;
+    struct Job *jobs;
+    int *v[4];
+    int i, n;
+
+    conf->num_valid = 0;
+    if (!finish(c, width, height, &conf->axys, &conf->swap_xy))
+        return false;
+
+    if (num_threads <= 0)
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads < 1)
+        num_threads = 1;
+
+    b.c = c;
+    b.width = width;
+    b.height = height;
+    b.swap_xy = conf->swap_xy;
+    b.num_resamples = num_resamples;
+    b.num_threads = num_threads;
+    b.axys = (XYinfo*)calloc(num_resamples, sizeof(XYinfo));
+    b.valid = (bool*)calloc(num_resamples, sizeof(bool));
+    jobs = (struct Job*)calloc(num_threads, sizeof(struct Job));
+    for (i = 0; i < 4; i++)
+        v[i] = (int*)calloc(num_resamples, sizeof(int));
+    if (b.axys != NULL && b.valid != NULL && jobs != NULL &&
+        v[0] != NULL && v[1] != NULL && v[2] != NULL && v[3] != NULL)
+    {
+        for (i = 0; i < num_threads; i++)
+        {
+            jobs[i].b = &b;
+            jobs[i].first = i;
+        }
+        run_jobs(jobs, num_threads);
+
+        n = 0;
+        for (i = 0; i < num_resamples; i++)
+        {
+            if (!b.valid[i])
+                continue;
+            v[0][n] = b.axys[i].x_min;
+            v[1][n] = b.axys[i].x_max;
+            v[2][n] = b.axys[i].y_min;
+            v[3][n] = b.axys[i].y_max;
+            n++;
+        }
+        conf->num_valid = n;
+
+        if (n > 0)
+        {
+            interval(v[0], n, &conf->low.x_min, &conf->high.x_min);
+            interval(v[1], n, &conf->low.x_max, &conf->high.x_max);
+            interval(v[2], n, &conf->low.y_min, &conf->high.y_min);
+            interval(v[3], n, &conf->low.y_max, &conf->high.y_max);
+        }
+    }
+    free(b.axys);
+    free(b.valid);
+    free(jobs);
+    for (i = 0; i < 4; i++)
+        free(v[i]);
+
+    /* most resamples should determine a calibration */
+    return conf->num_valid >= num_resamples / 2;
+}
+
+double
+interval_pixels (const struct Confidence *conf,
+                 int                      width,
+                 int                      height)
+{
+    double px_x = width / fabs((double)conf->axys.x_max - conf->axys.x_min);
+    double px_y = height / fabs((double)conf->axys.y_max - conf->axys.y_min);
+    double widest = (conf->high.x_min - conf->low.x_min) * px_x;
+
+    if ((conf->high.x_max - conf->low.x_max) * px_x > widest)
+        widest = (conf->high.x_max - conf->low.x_max) * px_x;
+    if ((conf->high.y_min - conf->low.y_min) * px_y > widest)
+        widest = (conf->high.y_min - conf->low.y_min) * px_y;
+    if ((conf->high.y_max - conf->low.y_max) * px_y > widest)
+        widest = (conf->high.y_max - conf->low.y_max) * px_y;
+
+    return widest;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _bootstrap_h
+#define _bootstrap_h
+
+#include "calibrator.h"
+
+/*
+ * Confidence of the calibration (--confidence), by bootstrap: the clicks
+ * are resampled with replacement and the calibration is refitted to each
+ * resample, in the orientation of the one of all clicks. The spread of the
+ * refitted bounds gives a 95% confidence interval for each of them.
+ *
+ * The resamples are spread over worker threads (if available); a resample
+ * only needs a struct Calib of its own, and is seeded by its number so the
+ * result does not depend on the nr of threads.
+ */
+#define NUM_RESAMPLES 2000
+
+struct Confidence
+{
+    /* the calibration of all clicks */
+    XYinfo axys;
+    bool swap_xy;
+
+    /* 95% interval of each bound */
+    XYinfo low;
+    XYinfo high;
+
+    /* nr of resamples that gave a calibration */
+    int num_valid;
+};
+
+/*
+ * returns false if there is no calibration (num_valid is 0) or too few
+ * resamples gave one
+ */
+bool   bootstrap       (struct Calib            *c,
+                        int                      width,
+                        int                      height,
+                        int                      num_resamples,
+                        int                      num_threads,
+                        struct Confidence        *conf);
+
+/* the widest of the intervals, in pixels of a width x height display */
+double interval_pixels (const struct Confidence *conf,
+                        int                      width,
+                        int                      height);
+
+#endif /* _bootstrap_h */
@@ -22,6 +22,8 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 
 #include "calibrator.h"
 
@@ -31,90 +33,602 @@
 void
 reset (struct Calib *c)
 {
+    int i;
+
+    if (c->num_clicks > 0)
+        c->count_resets++;
     c->num_clicks = 0;
+    c->num_rejected = 0;
+    c->noise = 0;
+
+    /* all points in order, or for adaptive placement the corners */
+    if (c->max_error > 0)
+    {
+        c->point[UL] = 0;
+        c->point[UR] = c->num_cols - 1;
+        c->point[LL] = (c->num_rows - 1) * c->num_cols;
+        c->point[LR] = num_points(c) - 1;
+        c->num_placed = 4;
+    }
+    else
+    {
+        for (i = 0; i < num_points(c); i++)
+            c->point[i] = i;
+        c->num_placed = num_points(c);
+    }
+}
+
+/* number of points of the grid */
+int
+num_points (struct Calib *c)
+{
+    return c->num_cols * c->num_rows;
+}
+
+/* number of points to click (so far, with adaptive placement) */
+int
+num_targets (struct Calib *c)
+{
+    return c->num_placed;
+}
+
+/* the point of the grid of click 'k' */
+int
+grid_point (struct Calib *c,
+            int           k)
+{
+    return c->point[k];
+}
+
+/*
+ * position of point 'i' on a display of width x height: the corner points
+ * are at the corner of the outer blocks, the others spread evenly between
+ */
+void
+get_target (struct Calib *c,
+            int           i,
+            int           width,
+            int           height,
+            double       *x,
+            double       *y)
+{
+    int delta_x = width/NUM_BLOCKS;
+    int delta_y = height/NUM_BLOCKS;
+
+    *x = delta_x + (i % c->num_cols) * (width - 2*delta_x - 1) / (double)(c->num_cols - 1);
+    *y = delta_y + (i / c->num_cols) * (height - 2*delta_y - 1) / (double)(c->num_rows - 1);
+}
+
+/* a threshold as given, scaled to the display's resolution */
+static int
+scale_threshold (struct Calib *c,
+                 int           threshold,
+                 bool          scale)
+{
+    if (!scale || c->px_per_mm <= 0)
+        return threshold;
+
+    return (int)(threshold * c->px_per_mm / REFERENCE_PX_PER_MM + 0.5);
+}
+
+/*
+ * The mis-click threshold: scaled to the display, and widened to the noise
+ * of the clicks so far (but not without bound, or it would let mis-clicks
+ * through on the strength of earlier ones).
+ */
+int
+misclick_threshold (struct Calib *c)
+{
+    int threshold = scale_threshold(c, c->threshold_misclick, c->scale_misclick);
+
+    if (threshold > 0 && NOISE_FACTOR * c->noise > threshold)
+    {
+        if (NOISE_FACTOR * c->noise < MAX_WIDEN * threshold)
+            threshold = NOISE_FACTOR * c->noise;
+        else
+            threshold = MAX_WIDEN * threshold;
+    }
+
+    return threshold;
+}
+
+/* the double-click threshold, scaled to the display */
+int
+doubleclick_threshold (struct Calib *c)
+{
+    return scale_threshold(c, c->threshold_doubleclick, c->scale_doubleclick);
 }
 
+/* median of 'n' values (sorts them in place) */
+static int
+median (int *v,
+        int  n)
+{
+    int i, j;
+
+    for (i = 1; i < n; i++)
+    {
+        int t = v[i];
+        for (j = i; j > 0 && v[j-1] > t; j--)
+            v[j] = v[j-1];
+        v[j] = t;
+    }
+    if (n % 2 == 1)
+        return v[n/2];
+    return (v[n/2-1] + v[n/2]) / 2;
+}
+
+/*
+ * Residual of point 'k' (with coordinates x, y) with respect to the other
+ * clicked points of its column and row, except click 'skip' (-1: none).
+ *
+ * Points in the same column should have (about) the same x coordinate and
+ * points in the same row the same y coordinate; or the other way around if
+ * 'swap_xy' is set. Comparing against the median of the group makes a single
+ * bad click unable to drag the reference along with it.
+ */
+static int
+residual (struct Calib *c,
+          int           k,
+          int           x,
+          int           y,
+          bool          swap_xy,
+          int           skip)
+{
+    /* with several rounds (add_round()), a column or row can hold up to
+     * MAX_POINTS clicks */
+    int col_v[MAX_POINTS], row_v[MAX_POINTS];
+    int n_col = 0, n_row = 0;
+    int res = 0;
+    int p = grid_point(c, k);
+    int d;
+    int i;
+
+    for (i = 0; i < c->num_clicks; i++)
+    {
+        int q = grid_point(c, i);
+
+        if (i == k || i == skip)
+            continue;
+        if (q % c->num_cols == p % c->num_cols)
+            col_v[n_col++] = swap_xy ? c->clicked_y[i] : c->clicked_x[i];
+        if (q / c->num_cols == p / c->num_cols)
+            row_v[n_row++] = swap_xy ? c->clicked_x[i] : c->clicked_y[i];
+    }
+
+    if (n_col > 0)
+        res = abs((swap_xy ? y : x) - median(col_v, n_col));
+    if (n_row > 0)
+    {
+        d = abs((swap_xy ? x : y) - median(row_v, n_row));
+        if (d > res)
+            res = d;
+    }
+
+    return res;
+}
+
+/*
+ * check whether the clicks so far (except click 'skip', -1: none) and the
+ * new click agree on an orientation
+ */
+static bool
+is_inlier (struct Calib *c,
+           int           x,
+           int           y,
+           int           skip)
+{
+    int threshold = misclick_threshold(c);
+    int orientation;
+
+    for (orientation = 0; orientation < 2; orientation++)
+    {
+        bool swap_xy = (orientation == 1);
+        bool consistent = true;
+        int i;
+
+        /* the accepted clicks should be consistent with this orientation */
+        for (i = 0; i < c->num_clicks && consistent; i++)
+        {
+            if (i != skip &&
+                residual(c, i, c->clicked_x[i], c->clicked_y[i], swap_xy, skip) >
+                    threshold)
+                consistent = false;
+        }
+
+        if (consistent &&
+            residual(c, c->num_clicks, x, y, swap_xy, skip) <= threshold)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * The earlier click that the new click keeps disagreeing with: of the
+ * clicks without which everything agrees, the one furthest off. Returns
+ * -1 if no single click explains it.
+ */
+static int
+find_outlier (struct Calib *c,
+              int           x,
+              int           y)
+{
+    int worst = -1, worst_res = -1;
+    int k;
+
+    for (k = 0; k < c->num_clicks; k++)
+    {
+        int res_x, res_y;
+
+        if (!is_inlier(c, x, y, k))
+            continue;
+
+        res_x = residual(c, k, c->clicked_x[k], c->clicked_y[k], false, -1);
+        res_y = residual(c, k, c->clicked_x[k], c->clicked_y[k], true, -1);
+        if (res_y < res_x)
+            res_x = res_y;
+        if (res_x > worst_res)
+        {
+            worst = k;
+            worst_res = res_x;
+        }
+    }
+
+    return worst;
+}
+
+/*
+ * Drop click 'k': its point moves to right after the current one, so it
+ * is pressed again once the current point is.
+ */
+static void
+drop_click (struct Calib *c,
+            int           k)
+{
+    int n = c->num_clicks;
+    int p = c->point[k];
+    int i;
+
+    for (i = k; i < n - 1; i++)
+    {
+        c->clicked_x[i] = c->clicked_x[i+1];
+        c->clicked_y[i] = c->clicked_y[i+1];
+    }
+    for (i = k; i < n; i++)
+        c->point[i] = c->point[i+1];
+    c->point[n] = p;
+    c->num_clicks--;
+    c->num_dropped++;
+}
+
+/*
+ * Spread of the clicks along their rows and columns: the median residual,
+ * in the orientation they agree on best.
+ */
+static void
+update_noise (struct Calib *c)
+{
+    int res[MAX_POINTS];
+    int orientation;
+    int i;
+
+    c->noise = 0;
+    if (c->num_clicks < NOISE_CLICKS)
+        return;
+
+    for (orientation = 0; orientation < 2; orientation++)
+    {
+        int m;
+
+        for (i = 0; i < c->num_clicks; i++)
+            res[i] = residual(c, i, c->clicked_x[i], c->clicked_y[i], orientation == 1, -1);
+        m = median(res, c->num_clicks);
+        if (orientation == 0 || m < c->noise)
+            c->noise = m;
+    }
+}
+
+static void place_target (struct Calib *c);
+
 /* add a click with the given coordinates */
 bool
 add_click (struct Calib *c,
            int           x,
            int           y)
 {
-    /* Double-click detection */
+    if (c->num_clicks >= num_targets(c))
+        return false;
+    c->count_clicks++;
+
+    /* Double-click detection (an earlier press of the same point, in an
+     * earlier round, is not one) */
     if (c->threshold_doubleclick > 0 && c->num_clicks > 0)
     {
+        int threshold = doubleclick_threshold(c);
         int i = c->num_clicks-1;
         while (i >= 0)
         {
-            if (abs(x - c->clicked_x[i]) <= c->threshold_doubleclick &&
-                abs(y - c->clicked_y[i]) <= c->threshold_doubleclick)
+            if (grid_point(c, i) != grid_point(c, c->num_clicks) &&
+                abs(x - c->clicked_x[i]) <= threshold &&
+                abs(y - c->clicked_y[i]) <= threshold)
             {
+                c->count_doubleclicks++;
                 return false;
             }
             i--;
         }
     }
 
-    /* Mis-click detection */
-    if (c->threshold_misclick > 0 && c->num_clicks > 0)
+    /* Mis-click detection: only the offending click is rejected */
+    if (c->threshold_misclick > 0 && c->num_clicks > 0 &&
+        !is_inlier(c, x, y, -1))
     {
-        bool misclick = true;
+        int k;
 
-        if (c->num_clicks == 1)
-        {
-            /* check that along one axis of first point */
-            if (along_axis(c, x,c->clicked_x[0],c->clicked_y[0]) ||
-                along_axis(c, y,c->clicked_x[0],c->clicked_y[0]))
-            {
-                misclick = false;
-            }
-        }
-        else if (c->num_clicks == 2)
-        {
-            /* check that along other axis of first point than second point */
-            if ((along_axis(c, y,c->clicked_x[0],c->clicked_y[0]) &&
-                 along_axis(c, c->clicked_x[1],c->clicked_x[0],c->clicked_y[0])) ||
-                (along_axis(c, x,c->clicked_x[0],c->clicked_y[0]) &&
-                 along_axis(c, c->clicked_y[1],c->clicked_x[0],c->clicked_y[0])))
-            {
-                misclick = false;
-            }
-        }
-        else if (c->num_clicks == 3)
+        c->num_rejected++;
+        if (c->num_rejected < MAX_REJECTED)
         {
-            /* check that along both axis of second and third point */
-            if ((along_axis(c, x,c->clicked_x[1],c->clicked_y[1]) &&
-                 along_axis(c, y,c->clicked_x[2],c->clicked_y[2])) ||
-                (along_axis(c, y,c->clicked_x[1],c->clicked_y[1]) &&
-                 along_axis(c, x,c->clicked_x[2],c->clicked_y[2])))
-            {
-                misclick = false;
-            }
+            c->count_misclicks++;
+            return false;
         }
 
-        if (misclick)
+        /* keeps disagreeing: one of the earlier clicks must be off, so
+         * that one is pressed again instead (or all, if that is not it) */
+        k = find_outlier(c, x, y);
+        if (k < 0)
         {
+            c->count_misclicks++;
             reset(c);
             return false;
         }
+        drop_click(c, k);
     }
 
     c->clicked_x[c->num_clicks] = x;
     c->clicked_y[c->num_clicks] = y;
     c->num_clicks++;
+    c->num_rejected = 0;
+    update_noise(c);
+
+    /* all placed points pressed: maybe another one is needed */
+    if (c->max_error > 0 && c->num_clicks == c->num_placed)
+        place_target(c);
 
     return true;
 }
 
-/* check whether the coordinates are along the respective axis */
+/*
+ * Least-squares line through the clicked x (or y) coordinates against the
+ * column (or row) of their points, leaving out click 'skip' (-1: none).
+ * Returns false if the clicks do not determine a line.
+ */
+static bool
+fit_line (struct Calib *c,
+          bool          use_y,
+          bool          by_row,
+          int           skip,
+          double       *offset,
+          double       *slope)
+{
+    double sum_g = 0, sum_v = 0, sum_gg = 0, sum_gv = 0;
+    double den;
+    int n = 0;
+    int i;
+
+    for (i = 0; i < c->num_clicks; i++)
+    {
+        int p = grid_point(c, i);
+        int g = by_row ? p / c->num_cols : p % c->num_cols;
+        int v = use_y ? c->clicked_y[i] : c->clicked_x[i];
+
+        if (i == skip)
+            continue;
+        sum_g += g;
+        sum_v += v;
+        sum_gg += g*g;
+        sum_gv += g*v;
+        n++;
+    }
+
+    den = n*sum_gg - sum_g*sum_g;
+    if (den == 0)
+        return false;
+
+    *slope = (n*sum_gv - sum_g*sum_v) / den;
+    *offset = (sum_v - *slope*sum_g) / n;
+
+    return true;
+}
+
+/*
+ * The fitted line, evaluated at the first and last column (or row).
+ * For the 2x2 grid this is simply the average of both clicks on each side.
+ */
+static bool
+fit_axis (struct Calib *c,
+          bool          use_y,
+          bool          by_row,
+          float        *first,
+          float        *last)
+{
+    int n_lines = by_row ? c->num_rows : c->num_cols;
+    double slope, offset;
+
+    if (!fit_line(c, use_y, by_row, -1, &offset, &slope))
+        return false;
+
+    *first = offset;
+    *last = offset + slope*(n_lines - 1);
+    return true;
+}
+
+/* should x and y be swapped? (compare the ends of the first row) */
+static bool
+is_swapped (struct Calib *c)
+{
+    int k = 0;
+
+    while (k < c->num_clicks - 1 && grid_point(c, k) != c->num_cols - 1)
+        k++;
+
+    return (abs (c->clicked_x [0] - c->clicked_x [k]) <
+            abs (c->clicked_y [0] - c->clicked_y [k]));
+}
+
+/*
+ * error of click 'k' (in pixels): its distance to where the calibration
+ * fitted to the other clicks puts it
+ */
+static double
+prediction_error (struct Calib *c,
+                  int           k,
+                  bool          swap_xy)
+{
+    int p = grid_point(c, k);
+    int col = p % c->num_cols;
+    int row = p / c->num_cols;
+    double offset_x, slope_x, offset_y, slope_y;
+    double dx, dy;
+
+    if (!fit_line(c, false, swap_xy, k, &offset_x, &slope_x) ||
+        !fit_line(c, true, !swap_xy, k, &offset_y, &slope_y))
+        return 0;
+
+    dx = c->clicked_x[k] - (offset_x + slope_x * (swap_xy ? row : col));
+    dy = c->clicked_y[k] - (offset_y + slope_y * (swap_xy ? col : row));
+
+    return sqrt(dx*dx + dy*dy);
+}
+
+/*
+ * Adaptive placement: predicts the error at each point of the grid that
+ * was not pressed, as the average of the prediction errors of the pressed
+ * ones weighted by their inverse square distance. The next point is the
+ * one with the largest predicted error (plus max_error, so that far away
+ * points win when nothing is known yet), times its distance to the pressed
+ * points. The corners (and center) alone can not show a bulging panel, so
+ * it only stops once the last two points placed were predicted within
+ * max_error as well.
+ */
+static void
+place_target (struct Calib *c)
+{
+    double error[MAX_POINTS];
+    bool pressed[MAX_POINTS];
+    bool swap_xy = is_swapped(c);
+    double worst = 0, best_score = 0;
+    int best = -1;
+    int k, p;
+
+    memset(pressed, 0, sizeof(pressed));
+    for (k = 0; k < c->num_clicks; k++)
+    {
+        error[k] = prediction_error(c, k, swap_xy);
+        pressed[grid_point(c, k)] = true;
+    }
+
+    for (p = 0; p < num_points(c); p++)
+    {
+        double sum_w = 0, sum_e = 0, min_d2 = -1;
+        double predicted, score;
+
+        if (pressed[p])
+            continue;
+
+        for (k = 0; k < c->num_clicks; k++)
+        {
+            int q = grid_point(c, k);
+            int dc = p % c->num_cols - q % c->num_cols;
+            int dr = p / c->num_cols - q / c->num_cols;
+            double d2 = dc*dc + dr*dr;
+
+            sum_w += 1 / d2;
+            sum_e += error[k] / d2;
+            if (min_d2 < 0 || d2 < min_d2)
+                min_d2 = d2;
+        }
+
+        predicted = sum_e / sum_w;
+        score = (predicted + c->max_error) * sqrt(min_d2);
+        if (predicted > worst)
+            worst = predicted;
+        if (best < 0 || score > best_score)
+        {
+            best = p;
+            best_score = score;
+        }
+    }
+
+    if (best < 0 || c->num_placed >= MAX_POINTS)
+        return;
+    if (c->num_clicks > 5 && worst < c->max_error &&
+        error[c->num_clicks - 1] < c->max_error &&
+        error[c->num_clicks - 2] < c->max_error)
+        return;
+    c->point[c->num_placed++] = best;
+}
+
+/*
+ * Restore clicks saved earlier: the 'num_placed' points of the grid in
+ * order, and the 'num_clicks' clicks on the first of them. Returns false
+ * (leaving the clicks as they are) if they do not fit the grid.
+ */
+bool
+restore_clicks (struct Calib *c,
+                int           num_placed,
+                const int    *point,
+                int           num_clicks,
+                const int    *x,
+                const int    *y)
+{
+    int k;
+
+    if (num_placed > MAX_POINTS || num_clicks > num_placed)
+        return false;
+    for (k = 0; k < num_placed; k++)
+        if (point[k] < 0 || point[k] >= num_points(c))
+            return false;
+
+    for (k = 0; k < num_placed; k++)
+        c->point[k] = point[k];
+    c->num_placed = num_placed;
+    for (k = 0; k < num_clicks; k++)
+    {
+        c->clicked_x[k] = x[k];
+        c->clicked_y[k] = y[k];
+    }
+    c->num_clicks = num_clicks;
+    c->num_rejected = 0;
+    update_noise(c);
+
+    return true;
+}
+
+/*
+ * Another round: the points pressed so far are to be pressed once more,
+ * after the ones placed. Returns false if there is no room for them.
+ */
 bool
-along_axis (struct Calib *c,
-            int           xy,
-            int           x0,
-            int           y0)
+add_round (struct Calib *c)
 {
-    return ((abs(xy - x0) <= c->threshold_misclick) ||
-            (abs(xy - y0) <= c->threshold_misclick));
+    bool pressed[MAX_POINTS];
+    int n = 0;
+    int k, p;
+
+    memset(pressed, 0, sizeof(pressed));
+    for (k = 0; k < c->num_clicks; k++)
+        pressed[grid_point(c, k)] = true;
+    for (p = 0; p < num_points(c); p++)
+        if (pressed[p])
+            n++;
+    if (c->num_placed + n > MAX_POINTS)
+        return false;
+
+    for (p = 0; p < num_points(c); p++)
+        if (pressed[p])
+            c->point[c->num_placed++] = p;
+    return true;
 }
 
 /* calculate and apply the calibration */
@@ -126,31 +640,52 @@ finish (struct Calib *c,
         bool         *swap)
 {
     bool swap_xy;
+
+    if (c->num_cols < 2 || c->num_rows < 2 || c->num_clicks < 4 ||
+        c->num_clicks != num_targets(c))
+        return false;
+
+    swap_xy = is_swapped(c);
+    if (!fit_calibration(c, width, height, swap_xy, new_axys))
+        return false;
+    *swap = swap_xy;
+
+    return true;
+}
+
+/*
+ * The calibration of all clicks so far, in the given orientation (e.g. to
+ * refit subsets of the clicks in the orientation of all of them). Returns
+ * false if the clicks do not determine it.
+ */
+bool
+fit_calibration (struct Calib *c,
+                 int           width,
+                 int           height,
+                 bool          swap_xy,
+                 XYinfo       *new_axys)
+{
     float scale_x;
     float scale_y;
+    float first;
+    float last;
     int delta_x;
     int delta_y;
     XYinfo axys = {-1, -1, -1, -1};
 
-    if (c->num_clicks != 4)
-        return false;
-
-    /* Should x and y be swapped? */
-    swap_xy = (abs (c->clicked_x [UL] - c->clicked_x [UR]) < abs (c->clicked_y [UL] - c->clicked_y [UR]));
-    if (swap_xy)
-    {
-        SWAP(c->clicked_x[LL], c->clicked_x[UR]);
-        SWAP(c->clicked_y[LL], c->clicked_y[UR]);
-    }
-
     /* Compute min/max coordinates. */
     /* These are scaled using the values of old_axys */
+    /* When swapped, x changes along the rows and y along the columns */
     scale_x = (c->old_axys.x_max - c->old_axys.x_min)/(float)width;
-    axys.x_min = ((c->clicked_x[UL] + c->clicked_x[LL]) * scale_x/2) + c->old_axys.x_min;
-    axys.x_max = ((c->clicked_x[UR] + c->clicked_x[LR]) * scale_x/2) + c->old_axys.x_min;
+    if (!fit_axis(c, false, swap_xy, &first, &last))
+        return false;
+    axys.x_min = (first * scale_x) + c->old_axys.x_min;
+    axys.x_max = (last * scale_x) + c->old_axys.x_min;
     scale_y = (c->old_axys.y_max - c->old_axys.y_min)/(float)height;
-    axys.y_min = ((c->clicked_y[UL] + c->clicked_y[UR]) * scale_y/2) + c->old_axys.y_min;
-    axys.y_max = ((c->clicked_y[LL] + c->clicked_y[LR]) * scale_y/2) + c->old_axys.y_min;
+    if (!fit_axis(c, true, !swap_xy, &first, &last))
+        return false;
+    axys.y_min = (first * scale_y) + c->old_axys.y_min;
+    axys.y_max = (last * scale_y) + c->old_axys.y_min;
 
     /* Add/subtract the offset that comes from not having the points in the
      * corners (using the same coordinate system they are currently in)
@@ -170,8 +705,132 @@ finish (struct Calib *c,
     }
 
     *new_axys = axys;
-    *swap = swap_xy;
 
     return true;
 }
 
+
+/*
+ * where a click at (x, y) with the old calibration ends up with the new
+ * one, as returned by finish() for the same display size
+ */
+void
+recalibrate (struct Calib *c,
+             const XYinfo *new_axys,
+             bool          swap_xy,
+             int           width,
+             int           height,
+             double        x,
+             double        y,
+             double       *new_x,
+             double       *new_y)
+{
+    XYinfo a = *new_axys;
+    double raw_x, raw_y;
+
+    /* back to the ranges of the raw axes */
+    if (swap_xy)
+    {
+        SWAP(a.x_min, a.y_max);
+        SWAP(a.y_min, a.x_max);
+    }
+
+    raw_x = c->old_axys.x_min + x * (c->old_axys.x_max - c->old_axys.x_min) / width;
+    raw_y = c->old_axys.y_min + y * (c->old_axys.y_max - c->old_axys.y_min) / height;
+
+    if (swap_xy)
+    {
+        *new_x = (raw_y - a.y_min) * width / (double)(a.y_max - a.y_min);
+        *new_y = (raw_x - a.x_min) * height / (double)(a.x_max - a.x_min);
+    }
+    else
+    {
+        *new_x = (raw_x - a.x_min) * width / (double)(a.x_max - a.x_min);
+        *new_y = (raw_y - a.y_min) * height / (double)(a.y_max - a.y_min);
+    }
+}
+
+/* determinant of the 3x3 matrix with columns a, b, c */
+static double
+det3 (const double *a,
+      const double *b,
+      const double *c)
+{
+    return a[0] * (b[1]*c[2] - b[2]*c[1]) -
+           b[0] * (a[1]*c[2] - a[2]*c[1]) +
+           c[0] * (a[1]*b[2] - a[2]*b[1]);
+}
+
+/*
+ * calculate the coordinate transformation matrix
+ *
+ * The clicks and the targets are in root window coordinates, so the
+ * targets include the offset of the monitor. Both are normalised to the
+ * whole screen, like the matrix itself, and an affine map from the clicks
+ * to the targets is fitted by least squares; that covers scaling, offsets,
+ * swapped axes and inversion alike. As the clicks already went through
+ * old_matrix, the new matrix is that map applied after old_matrix.
+ */
+bool
+finish_matrix (struct Calib *c,
+               const double *target_x,
+               const double *target_y,
+               int           screen_width,
+               int           screen_height)
+{
+    /* normal equations: columns of [sx sy 1]^T [sx sy 1] and right sides */
+    double col[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+    double rhs[2][3] = {{0, 0, 0}, {0, 0, 0}};
+    double fit[2][3];
+    double det;
+    int n = num_targets(c);
+    int i, j, k, axis;
+
+    if (c->num_clicks != n || n < 3)
+        return false;
+
+    for (k = 0; k < n; k++)
+    {
+        double v[3];
+        double t[2];
+
+        v[0] = c->clicked_x[k] / (double)screen_width;
+        v[1] = c->clicked_y[k] / (double)screen_height;
+        v[2] = 1;
+        t[0] = target_x[grid_point(c, k)] / screen_width;
+        t[1] = target_y[grid_point(c, k)] / screen_height;
+
+        for (i = 0; i < 3; i++)
+        {
+            for (j = 0; j < 3; j++)
+                col[j][i] += v[i] * v[j];
+            rhs[0][i] += v[i] * t[0];
+            rhs[1][i] += v[i] * t[1];
+        }
+    }
+
+    /* Cramer's rule */
+    det = det3(col[0], col[1], col[2]);
+    if (det == 0)
+        return false;
+    for (axis = 0; axis < 2; axis++)
+    {
+        fit[axis][0] = det3(rhs[axis], col[1], col[2]) / det;
+        fit[axis][1] = det3(col[0], rhs[axis], col[2]) / det;
+        fit[axis][2] = det3(col[0], col[1], rhs[axis]) / det;
+    }
+
+    /* new = fit * old, where fit has 0 0 1 as last row */
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+        {
+            if (i < 2)
+                c->new_matrix[3*i + j] = fit[i][0] * c->old_matrix[j] +
+                                         fit[i][1] * c->old_matrix[3 + j] +
+                                         fit[i][2] * c->old_matrix[6 + j];
+            else
+                c->new_matrix[3*i + j] = c->old_matrix[6 + j];
+        }
+
+    return true;
+}
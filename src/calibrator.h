@@ -24,6 +24,8 @@
 #ifndef _calibrator_h
 #define _calibrator_h
 
+#include "xinput_calibrator.h"
+
 /*
  * Number of blocks. We partition the screen into 'num_blocks' x 'num_blocks'
  * rectangles of equal size. We then ask the user to press points that are
@@ -52,7 +54,39 @@
  */
 #define NUM_BLOCKS 8
 
-/* Names of the points */
+/*
+ * The points are laid out on a grid of 'num_cols' x 'num_rows' points between
+ * the four corner points, numbered row by row. For the default 2x2 grid these
+ * are exactly the four points shown above.
+ */
+#define MAX_GRID   8
+#define MAX_POINTS (MAX_GRID * MAX_GRID)
+
+/*
+ * Number of consecutive mis-clicks on the same point after which we assume
+ * that one of the earlier clicks was the wrong one, and press that again.
+ */
+#define MAX_REJECTED 3
+
+/*
+ * The thresholds are in pixels of a 96 DPI display (or in pixels as given,
+ * see 'scale_misclick' and 'scale_doubleclick'). The mis-click threshold
+ * widens to NOISE_FACTOR times the spread of the clicks so far, up to
+ * MAX_WIDEN times itself, from the second click on (which is the first one
+ * there is a spread to measure, and on a 2x2 grid one of only four).
+ */
+#define REFERENCE_PX_PER_MM (96 / 25.4)
+#define NOISE_FACTOR 3
+#define MAX_WIDEN    2
+#define NOISE_CLICKS 2
+
+/* One-shot calibration: the points of the default grid, touched at once */
+#define ONE_SHOT_TOUCHES 4
+
+/* Maximum number of devices to choose from by touching the screen */
+#define MAX_CANDIDATES 16
+
+/* Names of the points (of the default 2x2 grid) */
 enum
 {
 	UL = 0, /* Upper-left  */
@@ -61,15 +95,6 @@ enum
 	LR = 3  /* Lower-right */
 };
 
-/* struct to hold min/max info of the X and Y axis */
-typedef struct
-{
-	int x_min;
-	int x_max;
-	int y_min;
-	int y_max;
-} XYinfo;
-
 typedef enum
 {
 	false = 0,
@@ -81,11 +106,55 @@ struct Calib
     /* original axys values */
     XYinfo old_axys;
 
+    /* the driver's current swap and inversion (inversion is in old_axys) */
+    bool old_swap_xy;
+    bool old_invert_x;
+    bool old_invert_y;
+
+    /* print debug messages (and timings) */
+    bool verbose;
+
+    /* XInput id and name of the device (-1 and NULL if unknown), the name
+     * malloc'ed */
+    int device_id;
+    char* device_name;
+
+    /* touch-to-select: the devices to choose from, until one is pressed */
+    int num_candidates;
+    int candidate_id[MAX_CANDIDATES];
+    char* candidate_name[MAX_CANDIDATES];
+    XYinfo candidate_axys[MAX_CANDIDATES];
+
+    /* X display of the device (NULL for the default one) */
+    const char* display_name;
+
+    /* multi-seat: the remaining displays, and their calibrators */
+    const char* more_displays;
+    struct Calib* next;
+
+    /* layout of the points: 'num_cols' x 'num_rows' grid */
+    int num_cols;
+    int num_rows;
+
     /* nr of clicks registered */
     int num_clicks;
 
     /* click coordinates */
-    int clicked_x[4], clicked_y[4];
+    int clicked_x[MAX_POINTS], clicked_y[MAX_POINTS];
+
+    /* nr of consecutive mis-clicks on the current point */
+    int num_rejected;
+
+    /* nr of earlier clicks dropped (to be pressed again) for being off */
+    int num_dropped;
+
+    /* counts over the whole session, not cleared by reset(): clicks given
+     * to add_click(), the ones rejected as double-clicks and as
+     * mis-clicks, and restarts with clicks lost */
+    int count_clicks;
+    int count_doubleclicks;
+    int count_misclicks;
+    int count_resets;
 
     /* Threshold to keep the same point from being clicked twice.
      * Set to zero if you don't want this check
@@ -98,22 +167,126 @@ struct Calib
      */
     int threshold_misclick;
 
+    /* resolution of the display in pixels per mm (0 if unknown); the
+     * thresholds are scaled to it if 'scale_misclick'/'scale_doubleclick'
+     * are set */
+    float px_per_mm;
+    bool scale_misclick;
+    bool scale_doubleclick;
+
+    /* spread of the clicks so far along their rows and columns (median
+     * residual, in pixels), which the mis-click threshold widens to */
+    int noise;
+
+    /* show the result on the calibration window before accepting it */
+    bool preview;
+
+    /* have a denser grid pressed with the result, to see its accuracy */
+    bool verify;
+
+    /* all points touched at once, on a multitouch screen */
+    bool one_shot;
+
+    /* The points of the grid to press, in order: point[k] is the one of
+     * the k-th click, set up by reset(). With adaptive placement
+     * (max_error > 0, in pixels) the grid holds the points that may be
+     * pressed, num_placed is the nr of points placed so far. A point can
+     * be in there more than once, see add_round().
+     */
+    float max_error;
+    int point[MAX_POINTS];
+    int num_placed;
+
     /* manually specified geometry string */
     const char* geometry;
+
+    /* file to write the non-linear correction grid to (or NULL) */
+    const char* correction_file;
+
+    /* file to record the session's clicks to (or NULL) */
+    const char* record_file;
+
+    /* file to write the session's metrics to (or NULL) */
+    const char* metrics_file;
+
+    /* file to save the clicks to after each one, and resume from (or NULL) */
+    const char* checkpoint_file;
+
+    /* bootstrap confidence (--confidence): the widest 95% interval of a
+     * bound to accept, in pixels (0: no estimate) */
+    float max_interval;
+
+    /* video wall (--wall): the window split into wall_cols x wall_rows
+     * tiles, each with a touch overlay of its own (0: no wall) */
+    int wall_cols;
+    int wall_rows;
+
+    /* developer mode (--soak): nr of sessions to run, with injected
+     * clicks, to look for leaks (0: off) */
+    int soak;
+
+    /* monitor to calibrate on (of the default screen) */
+    int monitor;
+
+    /* coordinate transformation matrix mode: current and new matrix */
+    bool use_matrix;
+    bool apply_matrix;
+    float old_matrix[9];
+    float new_matrix[9];
+
+    /* read the clicks from this event device or recording (or NULL) */
+    const char* evdev;
+    bool evdev_live;
 };
 
 void reset      (struct Calib *c);
+int  num_points (struct Calib *c);
+int  num_targets(struct Calib *c);
+int  grid_point (struct Calib *c,
+                 int           k);
+void get_target (struct Calib *c,
+                 int           i,
+                 int           width,
+                 int           height,
+                 double       *x,
+                 double       *y);
 bool add_click  (struct Calib *c,
                  int           x,
                  int           y);
-bool along_axis (struct Calib *c,
-                 int           xy,
-                 int           x0,
-                 int           y0);
+/* the thresholds in use now */
+int  misclick_threshold   (struct Calib *c);
+int  doubleclick_threshold(struct Calib *c);
+bool restore_clicks (struct Calib *c,
+                 int           num_placed,
+                 const int    *point,
+                 int           num_clicks,
+                 const int    *x,
+                 const int    *y);
+bool add_round  (struct Calib *c);
 bool finish     (struct Calib *c,
                  int           width,
                  int           height,
                  XYinfo       *new_axys,
                  bool         *swap);
+bool fit_calibration (struct Calib *c,
+                 int           width,
+                 int           height,
+                 bool          swap_xy,
+                 XYinfo       *new_axys);
+void recalibrate(struct Calib *c,
+                 const XYinfo *new_axys,
+                 bool          swap_xy,
+                 int           width,
+                 int           height,
+                 double        x,
+                 double        y,
+                 double       *new_x,
+                 double       *new_y);
+/* the targets are per point of the grid, see get_target() */
+bool finish_matrix (struct Calib *c,
+                 const double *target_x,
+                 const double *target_y,
+                 int           screen_width,
+                 int           screen_height);
 
 #endif /* _calibrator_h */
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+FILE*
+open_replacement (const char  *filename,
+                  char       **tmp)
+{
+    FILE *f;
+
+    *tmp = (char*)malloc(strlen(filename) + 5);
+    if (*tmp == NULL)
+        return NULL;
+    sprintf(*tmp, "%s.tmp", filename);
+
+    f = fopen(*tmp, "w");
+    if (f == NULL)
+    {
+        free(*tmp);
+        *tmp = NULL;
+    }
+
+    return f;
+}
+
+/*
+ * Synced before the rename, or a crash could leave the new name on a file
+ * whose data never reached the disk.
+ */
+bool
+replace_file (FILE       *f,
+              char       *tmp,
+              const char *filename)
+{
+    bool ok;
+
+    ok = (fflush(f) == 0 && fsync(fileno(f)) == 0);
+    if (fclose(f) != 0)
+        ok = false;
+    if (ok)
+        ok = (rename(tmp, filename) == 0);
+    if (!ok)
+        remove(tmp);
+    free(tmp);
+
+    return ok;
+}
+
+/*
+ * Written to a temporary file that is then renamed, so that an
+ * interruption while writing leaves the previous checkpoint.
+ */
+bool
+save_checkpoint (const char   *filename,
+                 struct Calib *c,
+                 int           width,
+                 int           height)
+{
+    char *tmp;
+    FILE *f;
+    int k;
+
+    f = open_replacement(filename, &tmp);
+    if (f == NULL)
+        return false;
+
+    fprintf(f, "checkpoint %d %d %d %d\n", width, height, c->num_cols, c->num_rows);
+    fprintf(f, "old_axys %d %d %d %d\n",
+            c->old_axys.x_min, c->old_axys.x_max, c->old_axys.y_min, c->old_axys.y_max);
+    fprintf(f, "device %s\n", c->device_name != NULL ? c->device_name : "");
+    for (k = 0; k < num_targets(c); k++)
+        fprintf(f, "point %d\n", grid_point(c, k));
+    for (k = 0; k < c->num_clicks; k++)
+        fprintf(f, "click %d %d\n", c->clicked_x[k], c->clicked_y[k]);
+
+    return replace_file(f, tmp, filename);
+}
+
+bool
+load_checkpoint (const char   *filename,
+                 struct Calib *c,
+                 int           width,
+                 int           height)
+{
+    int point[MAX_POINTS], x[MAX_POINTS], y[MAX_POINTS];
+    int num_placed = 0, num_clicks = 0;
+    bool fits = false;
+    char line[256];
+    FILE *f;
+
+    f = fopen(filename, "r");
+    if (f == NULL)
+        return false;
+
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        int w, h, cols, rows;
+        XYinfo axys;
+
+        if (sscanf(line, "checkpoint %d %d %d %d", &w, &h, &cols, &rows) == 4)
+        {
+            fits = (w == width && h == height &&
+                    cols == c->num_cols && rows == c->num_rows);
+        }
+        else if (sscanf(line, "old_axys %d %d %d %d", &axys.x_min, &axys.x_max,
+                        &axys.y_min, &axys.y_max) == 4)
+        {
+            fits = fits && axys.x_min == c->old_axys.x_min && axys.x_max == c->old_axys.x_max &&
+                   axys.y_min == c->old_axys.y_min && axys.y_max == c->old_axys.y_max;
+        }
+        else if (strncmp(line, "device ", 7) == 0)
+        {
+            line[strcspn(line, "\n")] = '\0';
+            fits = fits && strcmp(line + 7, c->device_name != NULL ? c->device_name : "") == 0;
+        }
+        else if (strncmp(line, "point ", 6) == 0)
+        {
+            if (num_placed < MAX_POINTS &&
+                sscanf(line + 6, "%d", &point[num_placed]) == 1)
+                num_placed++;
+        }
+        else if (strncmp(line, "click ", 6) == 0)
+        {
+            if (num_clicks < MAX_POINTS &&
+                sscanf(line + 6, "%d %d", &x[num_clicks], &y[num_clicks]) == 2)
+                num_clicks++;
+        }
+    }
+    fclose(f);
+
+    /* a finished calibration is not resumed */
+    if (!fits || num_clicks == 0 || num_clicks >= num_placed)
+        return false;
+
+    return restore_clicks(c, num_placed, point, num_clicks, x, y);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _checkpoint_h
+#define _checkpoint_h
+
+#include <stdio.h>
+
+#include "calibrator.h"
+
+/*
+ * Checkpoint of a calibration (--checkpoint), written after every click
+ * that changed the clicks so far, so that an interrupted calibration (a key
+ * press, the timeout) can be resumed. It is a text file:
+ *
+ *   checkpoint <width> <height> <cols> <rows>
+ *   old_axys <x_min> <x_max> <y_min> <y_max>
+ *   device <name>
+ *   point <grid point>
+ *   ...
+ *   click <x> <y>
+ *   ...
+ *
+ * with the points placed so far in order (see grid_point()) and the clicks
+ * on the first of them. It is only resumed for the same device, display
+ * size, grid and current calibration.
+ */
+
+bool save_checkpoint (const char   *filename,
+                      struct Calib *c,
+                      int           width,
+                      int           height);
+
+/* resume from the checkpoint, returns false if there is none that fits */
+bool load_checkpoint (const char   *filename,
+                      struct Calib *c,
+                      int           width,
+                      int           height);
+
+/*
+ * Files that must never be read half-written (the checkpoint, the metrics)
+ * are written to '<filename>.tmp', which replace_file() then syncs and
+ * renames over 'filename'. open_replacement() sets '*tmp' to the name of
+ * the temporary file, replace_file() closes the file and frees '*tmp'
+ * (and removes the file if it could not be written).
+ */
+FILE* open_replacement (const char  *filename,
+                        char       **tmp);
+
+bool replace_file (FILE       *f,
+                   char       *tmp,
+                   const char *filename);
+
+#endif /* _checkpoint_h */
@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "correction.h"
+
+/* at most a bicubic polynomial: x^i * y^j with i, j <= 3 */
+#define MAX_DEGREE 3
+#define MAX_TERMS  ((MAX_DEGREE + 1) * (MAX_DEGREE + 1))
+
+/* evaluate the terms x^i * y^j of the polynomial at (u, v) */
+static void
+poly_terms (double  u,
+            double  v,
+            int     deg_x,
+            int     deg_y,
+            double *terms)
+{
+    double pv = 1;
+    int i, j, n = 0;
+
+    for (j = 0; j <= deg_y; j++)
+    {
+        double pu = 1;
+        for (i = 0; i <= deg_x; i++)
+        {
+            terms[n++] = pu * pv;
+            pu *= u;
+        }
+        pv *= v;
+    }
+}
+
+/* solve the n x n system a*x = b in place (Gaussian elimination) */
+static bool
+solve (double a[MAX_TERMS][MAX_TERMS],
+       double *b,
+       int     n)
+{
+    int i, j, k;
+
+    for (k = 0; k < n; k++)
+    {
+        int pivot = k;
+        for (i = k+1; i < n; i++)
+            if (fabs(a[i][k]) > fabs(a[pivot][k]))
+                pivot = i;
+        if (fabs(a[pivot][k]) < 1e-12)
+            return false;
+
+        if (pivot != k)
+        {
+            double t;
+            for (j = 0; j < n; j++)
+            {
+                t = a[k][j]; a[k][j] = a[pivot][j]; a[pivot][j] = t;
+            }
+            t = b[k]; b[k] = b[pivot]; b[pivot] = t;
+        }
+
+        for (i = k+1; i < n; i++)
+        {
+            double f = a[i][k] / a[k][k];
+            for (j = k; j < n; j++)
+                a[i][j] -= f * a[k][j];
+            b[i] -= f * b[k];
+        }
+    }
+
+    for (k = n-1; k >= 0; k--)
+    {
+        for (j = k+1; j < n; j++)
+            b[k] -= a[k][j] * b[j];
+        b[k] /= a[k][k];
+    }
+
+    return true;
+}
+
+/*
+ * Fit a correction from the clicks on the grid of points, whose screen
+ * positions are given in 'target_x' and 'target_y'.
+ *
+ * Both are converted to device coordinates with old_axys, so the correction
+ * maps what the device reports to what it should have reported for the
+ * current (linear) calibration to hit the points.
+ */
+struct Correction*
+fit_correction (struct Calib  *c,
+                const double  *target_x,
+                const double  *target_y,
+                int            width,
+                int            height)
+{
+    struct Correction *cor;
+    double ata[2][MAX_TERMS][MAX_TERMS];
+    double atb[2][MAX_TERMS];
+    double terms[MAX_TERMS];
+    int range_x, range_y;
+    int deg_x, deg_y, n_terms;
+    int n = num_targets(c);
+    int axis, i, j, k;
+
+    if (c->num_clicks != n)
+        return NULL;
+
+    range_x = c->old_axys.x_max - c->old_axys.x_min;
+    range_y = c->old_axys.y_max - c->old_axys.y_min;
+    if (range_x == 0 || range_y == 0)
+        return NULL;
+
+    /* as many terms as the grid can determine */
+    deg_x = c->num_cols - 1 < MAX_DEGREE ? c->num_cols - 1 : MAX_DEGREE;
+    deg_y = c->num_rows - 1 < MAX_DEGREE ? c->num_rows - 1 : MAX_DEGREE;
+    /* and the clicks (with adaptive placement there may be fewer) */
+    while ((deg_x + 1) * (deg_y + 1) > n)
+    {
+        if (deg_x >= deg_y)
+            deg_x--;
+        else
+            deg_y--;
+    }
+    n_terms = (deg_x + 1) * (deg_y + 1);
+
+    /* normal equations, in device coordinates normalised to [0,1] */
+    memset(ata, 0, sizeof(ata));
+    memset(atb, 0, sizeof(atb));
+    for (k = 0; k < n; k++)
+    {
+        double u = c->clicked_x[k] / (double)width;
+        double v = c->clicked_y[k] / (double)height;
+        double want[2];
+
+        want[0] = target_x[grid_point(c, k)] / width;
+        want[1] = target_y[grid_point(c, k)] / height;
+
+        poly_terms(u, v, deg_x, deg_y, terms);
+        for (axis = 0; axis < 2; axis++)
+            for (i = 0; i < n_terms; i++)
+            {
+                for (j = 0; j < n_terms; j++)
+                    ata[axis][i][j] += terms[i] * terms[j];
+                atb[axis][i] += terms[i] * want[axis];
+            }
+    }
+    for (axis = 0; axis < 2; axis++)
+        if (!solve(ata[axis], atb[axis], n_terms))
+            return NULL;
+
+    /* sample the polynomial on the correction grid */
+    cor = (struct Correction*)calloc(1, sizeof(struct Correction));
+    cor->cols = CORRECTION_NODES;
+    cor->rows = CORRECTION_NODES;
+    cor->range = c->old_axys;
+    cor->scale_x = (cor->cols - 1) / (float)range_x;
+    cor->scale_y = (cor->rows - 1) / (float)range_y;
+    cor->nodes = (float*)malloc(2 * cor->cols * cor->rows * sizeof(float));
+
+    for (j = 0; j < cor->rows; j++)
+        for (i = 0; i < cor->cols; i++)
+        {
+            float *node = cor->nodes + 2*(j*cor->cols + i);
+            double sum[2] = {0, 0};
+
+            poly_terms(i / (double)(cor->cols - 1), j / (double)(cor->rows - 1),
+                       deg_x, deg_y, terms);
+            for (k = 0; k < n_terms; k++)
+            {
+                sum[0] += atb[0][k] * terms[k];
+                sum[1] += atb[1][k] * terms[k];
+            }
+            node[0] = c->old_axys.x_min + sum[0] * range_x;
+            node[1] = c->old_axys.y_min + sum[1] * range_y;
+        }
+
+    return cor;
+}
+
+/* correct a device coordinate: bilinear lookup in the grid */
+void
+apply_correction (const struct Correction *cor,
+                  int                      x,
+                  int                      y,
+                  int                     *cx,
+                  int                     *cy)
+{
+    float fx = (x - cor->range.x_min) * cor->scale_x;
+    float fy = (y - cor->range.y_min) * cor->scale_y;
+    const float *n00, *n01, *n10, *n11;
+    int ix, iy;
+
+    /* clamp to the grid, on both edges alike */
+    if (fx < 0)
+        fx = 0;
+    else if (fx > cor->cols - 1)
+        fx = cor->cols - 1;
+    if (fy < 0)
+        fy = 0;
+    else if (fy > cor->rows - 1)
+        fy = cor->rows - 1;
+    ix = (int)fx;
+    iy = (int)fy;
+    if (ix > cor->cols - 2)
+        ix = cor->cols - 2;
+    if (iy > cor->rows - 2)
+        iy = cor->rows - 2;
+    fx -= ix;
+    fy -= iy;
+
+    n00 = cor->nodes + 2*(iy*cor->cols + ix);
+    n01 = n00 + 2;
+    n10 = n00 + 2*cor->cols;
+    n11 = n10 + 2;
+
+    *cx = (int)((1-fy) * ((1-fx)*n00[0] + fx*n01[0]) +
+                   fy  * ((1-fx)*n10[0] + fx*n11[0]) + 0.5f);
+    *cy = (int)((1-fy) * ((1-fx)*n00[1] + fx*n01[1]) +
+                   fy  * ((1-fx)*n10[1] + fx*n11[1]) + 0.5f);
+}
+
+/* write the correction grid to a file */
+bool
+save_correction (const struct Correction *cor,
+                 const char              *filename)
+{
+    struct CorrectionHeader header;
+    size_t n = 2 * cor->cols * cor->rows;
+    FILE *f;
+    bool success;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CORRECTION_MAGIC, 4);
+    header.version = CORRECTION_VERSION;
+    header.cols = cor->cols;
+    header.rows = cor->rows;
+    header.range = cor->range;
+
+    f = fopen(filename, "wb");
+    if (f == NULL)
+        return false;
+    success = (fwrite(&header, sizeof(header), 1, f) == 1 &&
+               fwrite(cor->nodes, sizeof(float), n, f) == n);
+    if (fclose(f) != 0)
+        success = false;
+
+    return success;
+}
+
+/* map a correction grid file into memory, NULL if it is not a valid one */
+struct Correction*
+load_correction (const char *filename)
+{
+    struct Correction *cor;
+    const struct CorrectionHeader *header;
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(*header))
+    {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    header = (const struct CorrectionHeader*)map;
+    if (memcmp(header->magic, CORRECTION_MAGIC, 4) != 0 ||
+        header->version != CORRECTION_VERSION ||
+        header->cols < 2 || header->rows < 2 ||
+        header->cols > CORRECTION_MAX_NODES || header->rows > CORRECTION_MAX_NODES ||
+        header->range.x_max == header->range.x_min ||
+        header->range.y_max == header->range.y_min ||
+        (size_t)st.st_size < sizeof(*header) +
+            2 * (size_t)header->cols * (size_t)header->rows * sizeof(float))
+    {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    cor = (struct Correction*)calloc(1, sizeof(struct Correction));
+    cor->cols = header->cols;
+    cor->rows = header->rows;
+    cor->range = header->range;
+    cor->scale_x = (cor->cols - 1) / (float)(cor->range.x_max - cor->range.x_min);
+    cor->scale_y = (cor->rows - 1) / (float)(cor->range.y_max - cor->range.y_min);
+    cor->nodes = (float*)(header + 1);
+    cor->map = map;
+    cor->map_len = st.st_size;
+
+    return cor;
+}
+
+void
+free_correction (struct Correction *cor)
+{
+    if (cor == NULL)
+        return;
+    if (cor->map != NULL)
+        munmap(cor->map, cor->map_len);
+    else
+        free(cor->nodes);
+    free(cor);
+}
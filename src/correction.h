@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _correction_h
+#define _correction_h
+
+#include <stddef.h>
+
+#include "calibrator.h"
+
+/*
+ * Non-linear correction of the device coordinates.
+ *
+ * The clicks on a grid of points are fitted with a polynomial (bilinear up
+ * to bicubic, depending on the size of the grid) that maps the device
+ * coordinates to the ones that would have hit the points. That polynomial is
+ * then sampled on a grid of CORRECTION_NODES x CORRECTION_NODES nodes over
+ * the device range, so that correcting a coordinate is a bilinear lookup.
+ *
+ * On disk the grid is a CorrectionHeader followed by cols*rows pairs of
+ * floats (corrected x, y), row by row, in native byte order. The file can be
+ * mmap()'ed and used as is.
+ */
+#define CORRECTION_MAGIC   "XICG"
+#define CORRECTION_VERSION 1
+#define CORRECTION_NODES   33
+
+/* the most nodes a grid file may have along an axis */
+#define CORRECTION_MAX_NODES 256
+
+struct CorrectionHeader
+{
+    char magic[4];
+    int  version;
+
+    /* nr of grid nodes */
+    int  cols;
+    int  rows;
+
+    /* device range covered by the grid */
+    XYinfo range;
+};
+
+struct Correction
+{
+    int cols;
+    int rows;
+    XYinfo range;
+
+    /* nodes to grid cells */
+    float scale_x;
+    float scale_y;
+
+    /* cols*rows pairs of corrected x, y */
+    float *nodes;
+
+    /* the file mapping, if loaded from disk */
+    void  *map;
+    size_t map_len;
+};
+
+struct Correction* fit_correction  (struct Calib            *c,
+                                    const double            *target_x,
+                                    const double            *target_y,
+                                    int                      width,
+                                    int                      height);
+void               apply_correction(const struct Correction *cor,
+                                    int                      x,
+                                    int                      y,
+                                    int                     *cx,
+                                    int                     *cy);
+bool               save_correction (const struct Correction *cor,
+                                    const char              *filename);
+struct Correction* load_correction (const char              *filename);
+void               free_correction (struct Correction       *cor);
+
+#endif /* _correction_h */
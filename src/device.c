@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/XInput.h>
+
+#include "calibrator.h"
+
+static CalibTraceFunc trace_func = NULL;
+
+void calib_set_trace(CalibTraceFunc func)
+{
+    trace_func = func;
+}
+
+static void trace(int event, const char* text, double a, double b, double c, double d)
+{
+    if (trace_func != NULL)
+        trace_func(event, text, a, b, c, d);
+}
+
+/* strdup: non-ansi */
+static char* my_strdup(const char* s) {
+    size_t len = strlen(s) + 1;
+    void* p = malloc(len);
+
+    if (p == NULL)
+        return NULL;
+
+    return (char*) memcpy(p, s, len);
+}
+
+#ifdef HAVE_XI_PROP
+/* 'n' items of an integer property of the device, false if it has none */
+static bool
+int_property(Display* display, XDevice* dev, const char* name, int format,
+        unsigned long n, long* values)
+{
+    Atom prop = XInternAtom(display, name, True);
+    Atom type;
+    int act_format;
+    unsigned long nitems, bytes_after, i;
+    unsigned char* data;
+    bool found = false;
+
+    if (prop == None)
+        return false;
+    if (XGetDeviceProperty(display, dev, prop, 0, n, False, XA_INTEGER,
+            &type, &act_format, &nitems, &bytes_after, &data) != Success)
+        return false;
+
+    /* 32 bit items are passed as longs */
+    if (type == XA_INTEGER && act_format == format && nitems == n) {
+        for (i = 0; i < n; i++)
+            values[i] = (format == 8) ? ((char*)data)[i] : ((long*)data)[i];
+        found = true;
+    }
+    XFree(data);
+
+    return found;
+}
+#endif
+
+/**
+ * the calibration the (evdev) driver applies now, from its properties:
+ * the calibration replaces the axis ranges in *axys (unless the driver
+ * has none), swap and inversion are returned separately.
+ * returns false if the driver has none of these properties
+ */
+static bool
+driver_state(Display* display, int device_id, XYinfo* axys,
+        int* swap_xy, int* invert_x, int* invert_y)
+{
+    bool found = false;
+#ifdef HAVE_XI_PROP
+    long calib[4], swap[1], invert[2];
+    XDevice* dev = XOpenDevice(display, (XID)device_id);
+
+    if (dev == NULL)
+        return false;
+
+    if (int_property(display, dev, "Evdev Axis Calibration", 32, 4, calib)) {
+        axys->x_min = calib[0];
+        axys->x_max = calib[1];
+        axys->y_min = calib[2];
+        axys->y_max = calib[3];
+        found = true;
+    }
+    if (int_property(display, dev, "Evdev Axes Swap", 8, 1, swap)) {
+        *swap_xy = swap[0];
+        found = true;
+    }
+    if (int_property(display, dev, "Evdev Axis Inversion", 8, 2, invert)) {
+        *invert_x = invert[0];
+        *invert_y = invert[1];
+        found = true;
+    }
+    XCloseDevice(display, dev);
+#endif
+
+    return found;
+}
+
+static int find_devices(const char* display_name, const char* pre_device,
+        int list_devices,
+        int* device_id, char** device_name, XYinfo* device_axys,
+        int max, int* ids, char** names, XYinfo* axyss);
+
+/**
+ * find a calibratable touchscreen device (using XInput)
+ *
+ * if pre_device is NULL, the last calibratable device is selected.
+ * retuns number of devices found (or CALIB_ERROR_DISPLAY/CALIB_ERROR_XINPUT),
+ * the data of the device is returned in the last 3 function parameters
+ * (*device_name must be NULL or malloc'ed, it is replaced by a malloc'ed copy);
+ * the axes are those of the driver's current calibration, if it has one
+ */
+int calib_find_device(const char* display_name, const char* pre_device,
+        int verbose, int list_devices,
+        int* device_id, char** device_name, XYinfo* device_axys)
+{
+    return find_devices(display_name, pre_device, list_devices,
+            device_id, device_name, device_axys, 0, NULL, NULL, NULL);
+}
+
+int calib_find_devices(const char* display_name, int max_devices,
+        int* device_ids, char** device_names, XYinfo* device_axys)
+{
+    int device_id;
+    char* device_name = NULL;
+    XYinfo axys;
+    int found;
+
+    found = find_devices(display_name, NULL, 0, &device_id, &device_name, &axys,
+            max_devices, device_ids, device_names, device_axys);
+    free(device_name);
+
+    return found;
+}
+
+/*
+ * calib_find_device(), which also collects the first 'max' devices found
+ * (the names malloc'ed)
+ */
+static int find_devices(const char* display_name, const char* pre_device,
+        int list_devices,
+        int* device_id, char** device_name, XYinfo* device_axys,
+        int max, int* ids, char** names, XYinfo* axyss)
+{
+    bool pre_device_is_id = true;
+    int found = 0;
+
+    Display* display = XOpenDisplay(display_name);
+    if (display == NULL)
+        return CALIB_ERROR_DISPLAY;
+
+    int xi_opcode, event, error;
+    if (!XQueryExtension(display, "XInputExtension", &xi_opcode, &event, &error)) {
+        XCloseDisplay(display);
+        return CALIB_ERROR_XINPUT;
+    }
+
+    /* the Xi version, for the trace */
+    if (trace_func != NULL) {
+        XExtensionVersion *version = XGetExtensionVersion(display, INAME);
+
+        if (version && (version != (XExtensionVersion*) NoSuchExtension)) {
+            trace(CALIB_TRACE_XI_VERSION, NULL,
+                version->major_version, version->minor_version, 0, 0);
+            XFree(version);
+        }
+    }
+
+    if (pre_device != NULL) {
+        /* check whether the pre_device is an ID (only digits) */
+        int len = strlen(pre_device);
+        int loop;
+        for (loop=0; loop<len; loop++) {
+	        if (!isdigit(pre_device[loop])) {
+	            pre_device_is_id = false;
+	            break;
+	        }
+        }
+    }
+
+
+    trace(CALIB_TRACE_SKIP_MASTERS, NULL, 0, 0, 0, 0);
+    int ndevices;
+    XDeviceInfoPtr list, slist;
+    slist=list=(XDeviceInfoPtr) XListInputDevices (display, &ndevices);
+    int i;
+    for (i=0; i<ndevices; i++, list++)
+    {
+        if (list->use == IsXKeyboard || list->use == IsXPointer) /* virtual master device */
+            continue;
+
+        /* if we are looking for a specific device */
+        if (pre_device != NULL) {
+            if ((pre_device_is_id && list->id == (XID) atoi(pre_device)) ||
+                (!pre_device_is_id && strcmp(list->name, pre_device) == 0)) {
+                /* OK, fall through */
+            } else {
+                /* skip, not this device */
+                continue;
+            }
+        }
+
+        XAnyClassPtr any = (XAnyClassPtr) (list->inputclassinfo);
+        int j;
+        for (j=0; j<list->num_classes; j++)
+        {
+
+            if (any->class == ValuatorClass)
+            {
+                XValuatorInfoPtr V = (XValuatorInfoPtr) any;
+                XAxisInfoPtr ax = (XAxisInfoPtr) V->axes;
+
+                if (V->mode != Absolute) {
+                    trace(CALIB_TRACE_SKIP_RELATIVE, list->name, list->id, 0, 0, 0);
+                } else if (V->num_axes < 2 ||
+                    (ax[0].min_value == -1 && ax[0].max_value == -1) ||
+                    (ax[1].min_value == -1 && ax[1].max_value == -1)) {
+                    trace(CALIB_TRACE_SKIP_AXES, list->name, list->id, 0, 0, 0);
+                } else {
+                    /* a calibratable device (has 2 axis valuators) */
+                    found++;
+                    *device_id = (int)list->id;
+                    free(*device_name);
+                    *device_name = my_strdup(list->name);
+                    device_axys->x_min = ax[0].min_value;
+                    device_axys->x_max = ax[0].max_value;
+                    device_axys->y_min = ax[1].min_value;
+                    device_axys->y_max = ax[1].max_value;
+
+                    /* the driver's own calibration, if it has one; it
+                     * inverts after calibrating, which is the same as
+                     * swapping min and max */
+                    int swap_xy = 0, invert_x = 0, invert_y = 0;
+                    if (driver_state(display, *device_id, device_axys, &swap_xy, &invert_x, &invert_y)) {
+                        int t;
+                        if (invert_x) {
+                            t = device_axys->x_min;
+                            device_axys->x_min = device_axys->x_max;
+                            device_axys->x_max = t;
+                        }
+                        if (invert_y) {
+                            t = device_axys->y_min;
+                            device_axys->y_min = device_axys->y_max;
+                            device_axys->y_max = t;
+                        }
+                        trace(CALIB_TRACE_DRIVER_CALIB, list->name,
+                                device_axys->x_min, device_axys->x_max,
+                                device_axys->y_min, device_axys->y_max);
+                        trace(CALIB_TRACE_DRIVER_SWAP, list->name,
+                                swap_xy, invert_x, invert_y, 0);
+                    }
+
+                    if (found <= max) {
+                        ids[found-1] = *device_id;
+                        names[found-1] = my_strdup(list->name);
+                        axyss[found-1] = *device_axys;
+                    }
+
+                    if (list_devices)
+                        printf("Device \"%s\" id=%i\n", *device_name, (int)*device_id);
+                }
+
+            }
+
+            /*
+             * Increment 'any' to point to the next item in the linked
+             * list.  The length is in bytes, so 'any' must be cast to
+             * a character pointer before being incremented.
+             */
+            any = (XAnyClassPtr) ((char *) any + any->length);
+        }
+
+    }
+    XFreeDeviceList(slist);
+    XCloseDisplay(display);
+
+    return found;
+}
+
+int calib_get_driver_state(const char* display_name, int device_id,
+        int* swap_xy, int* invert_x, int* invert_y)
+{
+    XYinfo axys;
+    int found;
+
+    Display* display = XOpenDisplay(display_name);
+    if (display == NULL)
+        return 0;
+
+    *swap_xy = *invert_x = *invert_y = 0;
+    found = driver_state(display, device_id, &axys, swap_xy, invert_x, invert_y);
+    XCloseDisplay(display);
+
+    return found;
+}
+
+#ifdef HAVE_XI_PROP
+/* the matrix property of the device, opened on 'display' */
+static bool
+matrix_property(Display* display, int device_id, XDevice** dev, Atom* prop, Atom* float_atom)
+{
+    *prop = XInternAtom(display, "Coordinate Transformation Matrix", True);
+    *float_atom = XInternAtom(display, "FLOAT", True);
+    if (*prop == None || *float_atom == None)
+        return false;
+
+    *dev = XOpenDevice(display, (XID)device_id);
+    return (*dev != NULL);
+}
+#endif
+
+int calib_get_matrix(const char* display_name, int device_id, float* matrix)
+{
+    int success = 0;
+#ifdef HAVE_XI_PROP
+    Display* display = XOpenDisplay(display_name);
+    XDevice* dev;
+    Atom prop, float_atom, type;
+    int format;
+    unsigned long nitems, bytes_after;
+    unsigned char* data;
+
+    if (display == NULL)
+        return 0;
+
+    if (matrix_property(display, device_id, &dev, &prop, &float_atom)) {
+        if (XGetDeviceProperty(display, dev, prop, 0, 9, False, float_atom,
+                &type, &format, &nitems, &bytes_after, &data) == Success) {
+            /* 32 bit items are passed as longs */
+            if (type == float_atom && format == 32 && nitems == 9) {
+                int i;
+                for (i = 0; i < 9; i++)
+                    matrix[i] = *(float*)((long*)data + i);
+                success = 1;
+            }
+            XFree(data);
+        }
+        XCloseDevice(display, dev);
+    }
+    XCloseDisplay(display);
+#endif
+
+    return success;
+}
+
+int calib_set_matrix(const char* display_name, int device_id, const float* matrix)
+{
+    int success = 0;
+#ifdef HAVE_XI_PROP
+    Display* display = XOpenDisplay(display_name);
+    XDevice* dev;
+    Atom prop, float_atom;
+    long data[9];
+    int i;
+
+    if (display == NULL)
+        return 0;
+
+    if (matrix_property(display, device_id, &dev, &prop, &float_atom)) {
+        for (i = 0; i < 9; i++)
+            *(float*)(data + i) = matrix[i];
+        XChangeDeviceProperty(display, dev, prop, float_atom, 32,
+                PropModeReplace, (unsigned char*)data, 9);
+        XSync(display, False);
+        XCloseDevice(display, dev);
+        success = 1;
+    }
+    XCloseDisplay(display);
+#endif
+
+    return success;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "evdev.h"
+
+/*
+ * open an event device or recorded event stream for reading
+ * if 'grab' is set, the device is grabbed so that nobody else (e.g. the X
+ * server) gets its events; this is skipped for plain files, but fails (with
+ * errno set) if the device can not be grabbed, e.g. when another process has
+ */
+int
+open_evdev (const char *path,
+            bool        grab)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if (grab && ioctl(fd, EVIOCGRAB, (void*)1) < 0 && errno != ENOTTY && errno != EINVAL)
+    {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+/* get the range of the X and Y axis; false if not an event device */
+bool
+get_evdev_range (int     fd,
+                 XYinfo *range)
+{
+    struct input_absinfo abs_x, abs_y;
+
+    if (ioctl(fd, EVIOCGABS(ABS_X), &abs_x) < 0 ||
+        ioctl(fd, EVIOCGABS(ABS_Y), &abs_y) < 0)
+        return false;
+
+    range->x_min = abs_x.minimum;
+    range->x_max = abs_x.maximum;
+    range->y_min = abs_y.minimum;
+    range->y_max = abs_y.maximum;
+
+    return true;
+}
+
+/*
+ * read up to 'max' events (at least one, unless at the end of a file)
+ * returns the nr of events read, 0 at the end of the stream, -1 on error;
+ * a signal interrupts it, with errno EINTR, so that it can be acted upon
+ */
+int
+read_events (int                 fd,
+             struct input_event *ev,
+             int                 max)
+{
+    ssize_t len = read(fd, ev, max * sizeof(struct input_event));
+
+    if (len < 0)
+        return -1;
+
+    /* a truncated recording: drop the partial event */
+    return len / sizeof(struct input_event);
+}
+
+/*
+ * update the touch with an event
+ * returns true at the end of the frame (SYN_REPORT) in which it was pressed,
+ * so that both coordinates of the press are known
+ */
+bool
+track_touch (struct Touch             *touch,
+             const struct input_event *ev)
+{
+    switch (ev->type)
+    {
+    case EV_ABS:
+        if (ev->code == ABS_X)
+            touch->x = ev->value;
+        else if (ev->code == ABS_Y)
+            touch->y = ev->value;
+        break;
+
+    case EV_KEY:
+        if (ev->code == BTN_TOUCH || ev->code == BTN_LEFT)
+        {
+            if (ev->value == 1 && !touch->down)
+                touch->pressed = true;
+            touch->down = (ev->value != 0);
+        }
+        break;
+
+    case EV_SYN:
+        if (ev->code == SYN_REPORT && touch->pressed)
+        {
+            touch->pressed = false;
+            return true;
+        }
+        break;
+    }
+
+    return false;
+}
+
+/*
+ * scale the device coordinates of a touch to a display of width x height
+ * with 'range' as old_axys, finish() scales them back to device coordinates
+ */
+void
+scale_touch (const XYinfo       *range,
+             int                 width,
+             int                 height,
+             const struct Touch *touch,
+             int                *x,
+             int                *y)
+{
+    *x = (touch->x - range->x_min) * (double)width / (range->x_max - range->x_min) + 0.5;
+    *y = (touch->y - range->y_min) * (double)height / (range->y_max - range->y_min) + 0.5;
+}
+
+/*
+ * calibrate from a recorded event stream, without any GUI:
+ * the presses are fed to the calibrator as if they were clicks on a display
+ * of the given geometry
+ */
+bool
+replay_clicks (struct Calib *c,
+               XYinfo       *new_axys,
+               bool         *swap)
+{
+    struct input_event ev[64];
+    struct Touch touch = {0, 0, false, false};
+    int width, height;
+    int fd, n, i;
+
+    if (c->geometry == NULL || sscanf(c->geometry, "%dx%d", &width, &height) != 2)
+    {
+        fprintf(stderr, "Error: replaying events needs the --geometry of the display\n");
+        return false;
+    }
+
+    fd = open_evdev(c->evdev, false);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: unable to open '%s'\n", c->evdev);
+        return false;
+    }
+
+    reset(c);
+    while (c->num_clicks < num_targets(c) && (n = read_events(fd, ev, 64)) > 0)
+    {
+        for (i = 0; i < n && c->num_clicks < num_targets(c); i++)
+        {
+            if (track_touch(&touch, &ev[i]))
+            {
+                int x, y;
+                scale_touch(&c->old_axys, width, height, &touch, &x, &y);
+                add_click(c, x, y);
+            }
+        }
+    }
+    close(fd);
+
+    return finish(c, width, height, new_axys, swap);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _evdev_h
+#define _evdev_h
+
+#include <linux/input.h>
+
+#include "calibrator.h"
+
+/*
+ * Access to a Linux event device (/dev/input/eventN), or to a recorded
+ * stream of its events (e.g. 'cat /dev/input/eventN > file'), which is read
+ * the same way: a sequence of struct input_event.
+ */
+
+/* a single touch (or pen/button press), tracked from the events */
+struct Touch
+{
+    int  x;
+    int  y;
+    bool down;
+
+    /* pressed since the last SYN_REPORT */
+    bool pressed;
+};
+
+int  open_evdev      (const char         *path,
+                      bool                grab);
+bool get_evdev_range (int                 fd,
+                      XYinfo             *range);
+int  read_events     (int                 fd,
+                      struct input_event *ev,
+                      int                 max);
+bool track_touch     (struct Touch       *touch,
+                      const struct input_event *ev);
+void scale_touch     (const XYinfo       *range,
+                      int                 width,
+                      int                 height,
+                      const struct Touch *touch,
+                      int                *x,
+                      int                *y);
+bool replay_clicks   (struct Calib       *c,
+                      XYinfo             *new_axys,
+                      bool               *swap);
+
+#endif /* _evdev_h */
@@ -23,10 +23,22 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <float.h>
 #include <gtk/gtk.h>
+#include <gdk/gdkkeysyms.h>
 #include <cairo.h>
+#ifdef HAVE_XI22
+#include <X11/extensions/XInput2.h>
+#endif
 
 #include "calibrator.h"
+#include "correction.h"
+#include "bootstrap.h"
+#include "checkpoint.h"
+#include "verify.h"
+#include "trace.h"
 #include "gui_gtk.h"
 
 #define MAXIMUM(x,y) ((x) > (y) ? (x) : (y))
@@ -35,6 +47,13 @@
 #define M_PI 3.14159265358979323846264338327
 #endif
 
+#ifndef GDK_KEY_Return
+#define GDK_KEY_Return    GDK_Return
+#define GDK_KEY_KP_Enter  GDK_KP_Enter
+#define GDK_KEY_r         GDK_r
+#define GDK_KEY_R         GDK_R
+#endif
+
 /* Timeout parameters */
 const int time_step = 100;  /* in milliseconds */
 const int max_time = 15000; /* 5000 = 5 sec */
@@ -45,6 +64,13 @@ const int cross_circle = 4;
 const int clock_radius = 50;
 const int clock_line_width = 10;
 
+/* Press marker */
+const int press_radius = 8;
+const int press_time = 500; /* in milliseconds */
+
+/* Verification: the error vectors are drawn this many times their size */
+const int error_magnify = 5;
+
 /* Text printed on screen */
 const int font_size = 16;
 #define HELP_LINES (sizeof help_text / sizeof help_text[0])
@@ -63,7 +89,9 @@ CalibrationArea_(struct Calib *c)
 
     calib_area = (struct CalibArea*)calloc(1, sizeof(struct CalibArea));
     calib_area->calibrator = c;
+    /* our own reference: it outlives the window, see free_gui() */
     calib_area->drawing_area = gtk_drawing_area_new();
+    g_object_ref_sink(calib_area->drawing_area);
 
     /* Listen for mouse events */
     gtk_widget_add_events(calib_area->drawing_area, GDK_KEY_PRESS_MASK | GDK_BUTTON_PRESS_MASK);
@@ -75,6 +103,13 @@ CalibrationArea_(struct Calib *c)
     g_signal_connect(calib_area->drawing_area, "button-press-event", G_CALLBACK(on_button_press_event), calib_area);
     g_signal_connect(calib_area->drawing_area, "key-press-event", G_CALLBACK(on_key_press_event), calib_area);
 
+    /* the preview follows the pointer */
+    if (c->preview)
+    {
+        gtk_widget_add_events(calib_area->drawing_area, GDK_POINTER_MOTION_MASK);
+        g_signal_connect(calib_area->drawing_area, "motion-notify-event", G_CALLBACK(on_motion_notify_event), calib_area);
+    }
+
     /* parse geometry string */
     if (geo != NULL)
     {
@@ -93,40 +128,85 @@ CalibrationArea_(struct Calib *c)
     }
 
     /* Setup timer for animation */
-    g_timeout_add(time_step, (GSourceFunc)on_timer_signal, calib_area);
+    calib_area->timer_source = g_timeout_add(time_step, (GSourceFunc)on_timer_signal, calib_area);
 
     return calib_area;
 }
 
+/* video wall: calibrate tile 't' now, its points in window coordinates */
+static void
+show_tile(struct CalibArea *calib_area,
+          int               t)
+{
+    struct Wall *wall = calib_area->wall;
+    int i;
+
+    calib_area->current_tile = t;
+    calib_area->calibrator = wall->tile[t];
+    for (i = 0; i < num_points(wall->tile[t]); i++)
+    {
+        calib_area->X[i] = wall->target_x[t][i] - calib_area->monitor.x;
+        calib_area->Y[i] = wall->target_y[t][i] - calib_area->monitor.y;
+    }
+
+    sprintf(calib_area->tile_message, "Tile %d of %d: press its points", t + 1, wall->num_tiles);
+    draw_message(calib_area, calib_area->tile_message);
+    redraw(calib_area);
+}
+
 void
 set_display_size(struct CalibArea *calib_area,
                  int               width,
                  int               height)
 {
-    int delta_x;
-    int delta_y;
+    struct Calib *c = calib_area->calibrator;
+    int i;
 
     calib_area->display_width = width;
     calib_area->display_height = height;
 
     /* Compute absolute circle centers */
-    delta_x = calib_area->display_width/NUM_BLOCKS;
-    delta_y = calib_area->display_height/NUM_BLOCKS;
+    for (i = 0; i < num_points(calib_area->calibrator); i++)
+        get_target(calib_area->calibrator, i, width, height,
+                   &calib_area->X[i], &calib_area->Y[i]);
+
+    /* reset calibration if already started */
+    reset(calib_area->calibrator);
+    calib_area->record_started = false;
+    calib_area->previewing = false;
+    calib_area->verifying = false;
 
-    calib_area->X[UL] = delta_x;
-    calib_area->Y[UL] = delta_y;
+    /* a video wall: its tiles over the display, from the first one */
+    if (calib_area->wall != NULL)
+    {
+        layout_wall(calib_area->wall, calib_area->monitor.x, calib_area->monitor.y, width, height);
+        show_tile(calib_area, 0);
+        return;
+    }
 
-    calib_area->X[UR] = calib_area->display_width - delta_x - 1;
-    calib_area->Y[UR] = delta_y;
+    /* or pick up an interrupted one, for this size */
+    if (c->checkpoint_file != NULL && load_checkpoint(c->checkpoint_file, c, width, height))
+    {
+        printf("Resuming the calibration from '%s': %d of %d points pressed\n",
+               c->checkpoint_file, c->num_clicks, num_targets(c));
+        draw_message(calib_area, "Resuming the calibration where it was left");
+    }
+}
 
-    calib_area->X[LL] = delta_x;
-    calib_area->Y[LL] = calib_area->display_height - delta_y - 1;
+/* save the clicks so far to the checkpoint (none: remove it) */
+static void
+save_progress(struct CalibArea *calib_area)
+{
+    struct Calib *c = calib_area->calibrator;
 
-    calib_area->X[LR] = calib_area->display_width - delta_x - 1;
-    calib_area->Y[LR] = calib_area->display_height - delta_y - 1;
+    if (c->checkpoint_file == NULL)
+        return;
 
-    /* reset calibration if already started */
-    reset(calib_area->calibrator);
+    if (c->num_clicks == 0)
+        remove(c->checkpoint_file);
+    else if (!save_checkpoint(c->checkpoint_file, c,
+                              calib_area->display_width, calib_area->display_height))
+        fprintf(stderr, "Warning: unable to write checkpoint to '%s'\n", c->checkpoint_file);
 }
 
 void
@@ -163,10 +243,122 @@ on_expose_event(GtkWidget      *widget,
     return true;
 }
 
+/* a target: cross with a circle, in the current color */
+static void
+draw_target(cairo_t *cr,
+            double   x,
+            double   y)
+{
+    cairo_set_line_width(cr, 1);
+    cairo_move_to(cr, x - cross_lines, y);
+    cairo_rel_line_to(cr, cross_lines*2, 0);
+    cairo_move_to(cr, x, y - cross_lines);
+    cairo_rel_line_to(cr, 0, cross_lines*2);
+    cairo_stroke(cr);
+
+    cairo_arc(cr, x, y, cross_circle, 0.0, 2.0 * M_PI);
+    cairo_stroke(cr);
+}
+
+/* the tiles of a video wall, the current one framed */
+static void
+draw_tiles(struct CalibArea *calib_area,
+           cairo_t          *cr)
+{
+    const struct Wall *wall = calib_area->wall;
+    int t;
+
+    for (t = 0; t < wall->num_tiles; t++)
+    {
+        if (t == calib_area->current_tile)
+        {
+            cairo_set_source_rgb(cr, 0.8, 0.0, 0.0);
+            cairo_set_line_width(cr, 4);
+        }
+        else
+        {
+            cairo_set_source_rgb(cr, 0.6, 0.6, 0.6);
+            cairo_set_line_width(cr, 1);
+        }
+        cairo_rectangle(cr, wall->tile_x[t] - calib_area->monitor.x + 2,
+                        wall->tile_y[t] - calib_area->monitor.y + 2,
+                        wall->tile_width[t] - 4, wall->tile_height[t] - 4);
+        cairo_stroke(cr);
+    }
+    cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+}
+
+/* the heatmap of the verification (green to red) and its error vectors */
+static void
+draw_heatmap(struct CalibArea *calib_area,
+             cairo_t          *cr)
+{
+    const struct Verification *v = &calib_area->verify;
+    double cell_w = calib_area->display_width / (double)VERIFY_HEAT;
+    double cell_h = calib_area->display_height / (double)VERIFY_HEAT;
+    int i;
+
+    for (i = 0; i < VERIFY_HEAT * VERIFY_HEAT; i++)
+    {
+        double t = v->heat[i] / VERIFY_FULL_SCALE;
+
+        if (t > 1)
+            t = 1;
+        cairo_set_source_rgb(cr, t, 0.8 * (1 - t), 0.0);
+        cairo_rectangle(cr, (i % VERIFY_HEAT) * cell_w, (i / VERIFY_HEAT) * cell_h,
+                        cell_w + 1, cell_h + 1);
+        cairo_fill(cr);
+    }
+
+    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+    cairo_set_line_width(cr, 2);
+    for (i = 0; i < VERIFY_POINTS; i++)
+    {
+        cairo_arc(cr, v->target_x[i], v->target_y[i], cross_circle, 0.0, 2.0 * M_PI);
+        cairo_fill(cr);
+        cairo_move_to(cr, v->target_x[i], v->target_y[i]);
+        cairo_rel_line_to(cr, error_magnify * v->error_x[i], error_magnify * v->error_y[i]);
+        cairo_stroke(cr);
+    }
+    cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+}
+
+/*
+ * whether this expose paints the target to press next, as the full redraw
+ * after a press does (and those of the clock and the marker do not)
+ */
+static bool
+exposes_target(struct CalibArea *calib_area,
+               cairo_t          *cr)
+{
+    struct Calib *c = calib_area->calibrator;
+    struct Verification *v = &calib_area->verify;
+    double x1, y1, x2, y2, x, y;
+
+    if (calib_area->verifying && v->num_pressed < VERIFY_POINTS)
+    {
+        x = v->target_x[v->num_pressed];
+        y = v->target_y[v->num_pressed];
+    }
+    else if (!calib_area->verifying && c->num_clicks < num_targets(c))
+    {
+        int p = grid_point(c, c->num_clicks);
+        x = calib_area->X[p];
+        y = calib_area->Y[p];
+    }
+    else
+        /* nothing left to press: the redraw of the result */
+        return true;
+
+    cairo_clip_extents(cr, &x1, &y1, &x2, &y2);
+    return x1 <= x && x <= x2 && y1 <= y && y <= y2;
+}
+
 void
 draw(GtkWidget *widget, cairo_t *cr, gpointer data)
 {
     struct CalibArea *calib_area = (struct CalibArea*)data;
+    bool drawn[MAX_POINTS];
     int i;
     double text_height;
     double text_width;
@@ -176,6 +368,12 @@ draw(GtkWidget *widget, cairo_t *cr, gpointer data)
 
     resize_display(calib_area);
 
+    /* the result of the verification, below everything else */
+    if (calib_area->verifying && calib_area->verify.num_pressed == VERIFY_POINTS)
+        draw_heatmap(calib_area, cr);
+    if (calib_area->wall != NULL)
+        draw_tiles(calib_area, cr);
+
     /* Print the text */
     cairo_set_font_size(cr, font_size);
     text_height = -1;
@@ -205,24 +403,37 @@ draw(GtkWidget *widget, cairo_t *cr, gpointer data)
     }
     cairo_stroke(cr);
 
-    /* Draw the points */
-    for (i = 0; i <= calib_area->calibrator->num_clicks; i++)
+    /* Draw the points of the verification, while it lasts */
+    for (i = calib_area->verifying ? calib_area->verify.num_pressed : VERIFY_POINTS;
+         i < VERIFY_POINTS; i++)
+    {
+        if (i == calib_area->verify.num_pressed)
+            cairo_set_source_rgb(cr, 0.8, 0.0, 0.0);
+        else
+            cairo_set_source_rgb(cr, 0.6, 0.6, 0.6);
+        draw_target(cr, calib_area->verify.target_x[i], calib_area->verify.target_y[i]);
+    }
+
+    /* Draw the points: the current one and those still to press too (of a
+     * point pressed in more rounds, only the last round) */
+    memset(drawn, 0, sizeof(drawn));
+    for (i = calib_area->verifying ? -1 : num_targets(calib_area->calibrator) - 1; i >= 0; i--)
     {
-        /* set color: already clicked or not */
+        int p = grid_point(calib_area->calibrator, i);
+
+        if (drawn[p])
+            continue;
+        drawn[p] = true;
+
+        /* set color: already clicked, current or still to press */
         if (i < calib_area->calibrator->num_clicks)
             cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
-        else
+        else if (i == calib_area->calibrator->num_clicks || calib_area->one_shot)
             cairo_set_source_rgb(cr, 0.8, 0.0, 0.0);
+        else
+            cairo_set_source_rgb(cr, 0.6, 0.6, 0.6);
 
-        cairo_set_line_width(cr, 1);
-        cairo_move_to(cr, calib_area->X[i] - cross_lines, calib_area->Y[i]);
-        cairo_rel_line_to(cr, cross_lines*2, 0);
-        cairo_move_to(cr, calib_area->X[i], calib_area->Y[i] - cross_lines);
-        cairo_rel_line_to(cr, 0, cross_lines*2);
-        cairo_stroke(cr);
-
-        cairo_arc(cr, calib_area->X[i], calib_area->Y[i], cross_circle, 0.0, 2.0 * M_PI);
-        cairo_stroke(cr);
+        draw_target(cr, calib_area->X[p], calib_area->Y[p]);
     }
 
     /* Draw the clock background */
@@ -258,6 +469,38 @@ draw(GtkWidget *widget, cairo_t *cr, gpointer data)
         cairo_show_text(cr, calib_area->message);
         cairo_stroke(cr);
     }
+
+    /* Draw the preview: where it is now and where it will be */
+    if (calib_area->previewing && calib_area->preview_shown)
+    {
+        cairo_set_line_width(cr, 2);
+        cairo_set_source_rgb(cr, 0.8, 0.0, 0.0);
+        cairo_arc(cr, calib_area->raw_x, calib_area->raw_y, press_radius, 0.0, 2.0 * M_PI);
+        cairo_stroke(cr);
+
+        cairo_set_source_rgb(cr, 0.0, 0.6, 0.0);
+        cairo_move_to(cr, calib_area->new_x - cross_lines, calib_area->new_y);
+        cairo_rel_line_to(cr, cross_lines*2, 0);
+        cairo_move_to(cr, calib_area->new_x, calib_area->new_y - cross_lines);
+        cairo_rel_line_to(cr, 0, cross_lines*2);
+        cairo_stroke(cr);
+    }
+
+    /* Draw the press marker (if any) */
+    if (calib_area->press_time > 0)
+    {
+        cairo_arc(cr, calib_area->press_x, calib_area->press_y, press_radius, 0.0, 2.0 * M_PI);
+        cairo_set_source_rgb(cr, 0.0, 0.6, 0.0);
+        cairo_fill(cr);
+    }
+
+    /* the full redraw after a press is done */
+    if (calib_area->press_pending && exposes_target(calib_area, cr))
+    {
+        calib_area->press_pending = false;
+        TRACE(TRACE_PRESS_REDRAW,
+              1000 * (g_timer_elapsed(calib_area->session_timer, NULL) - calib_area->press_start), 0, 0, 0);
+    }
 }
 
 void
@@ -275,17 +518,96 @@ redraw(struct CalibArea *calib_area)
     }
 }
 
+/* the region of 'radius' around x, y */
+static void
+invalidate_around(struct CalibArea *calib_area,
+                  int               x,
+                  int               y,
+                  int               radius)
+{
+    GdkWindow *win = gtk_widget_get_window(calib_area->drawing_area);
+    if (win)
+    {
+        GdkRectangle rect;
+        rect.x = x - radius - 1;
+        rect.y = y - radius - 1;
+        rect.width = 2 * radius + 2;
+        rect.height = 2 * radius + 2;
+        gdk_window_invalidate_rect(win, &rect, false);
+    }
+}
+
+static void
+invalidate_press(struct CalibArea *calib_area)
+{
+    invalidate_around(calib_area, calib_area->press_x, calib_area->press_y, press_radius);
+}
+
+/* a click position in window coordinates (those of the event device already are) */
+static void
+to_window(struct CalibArea *calib_area,
+          int              *x,
+          int              *y)
+{
+    if (calib_area->calibrator->evdev == NULL)
+    {
+        *x -= calib_area->monitor.x;
+        *y -= calib_area->monitor.y;
+    }
+}
+
+/*
+ * Acknowledge a press right away: paint a marker at it, by invalidating
+ * and updating only its small region, before the click is handled and the
+ * whole scene is redrawn.
+ */
+void
+show_press(struct CalibArea *calib_area,
+           int               x,
+           int               y)
+{
+    GdkWindow *win = gtk_widget_get_window(calib_area->drawing_area);
+
+    TRACE(TRACE_PRESS, x, y, 0, 0);
+    calib_area->press_start = g_timer_elapsed(calib_area->session_timer, NULL);
+
+    /* the previous marker goes away */
+    if (calib_area->press_time > 0)
+        invalidate_press(calib_area);
+
+    to_window(calib_area, &x, &y);
+    calib_area->press_x = x;
+    calib_area->press_y = y;
+    calib_area->press_time = press_time;
+    invalidate_press(calib_area);
+
+    if (win)
+    {
+        gdk_window_process_updates(win, false);
+        gdk_flush();
+    }
+
+    TRACE(TRACE_PRESS_MARKER,
+          1000 * (g_timer_elapsed(calib_area->session_timer, NULL) - calib_area->press_start), 0, 0, 0);
+    calib_area->press_pending = true;
+}
+
 bool
 on_timer_signal(struct CalibArea *calib_area)
 {
     GdkWindow *win;
     GtkWidget *parent = gtk_widget_get_parent(calib_area->drawing_area);
 
+    /* a trace dump asked for with SIGUSR1 */
+    trace_poll();
+
     calib_area->time_elapsed += time_step;
     if (calib_area->time_elapsed > max_time || parent == NULL)
     {
+        calib_area->timed_out = (parent != NULL);
         if (parent)
             gtk_widget_destroy(parent);
+        calib_area->timer_source = 0;
         return false;
     }
 
@@ -301,41 +623,744 @@ on_timer_signal(struct CalibArea *calib_area)
         gdk_window_invalidate_rect(win, &rect, false);
     }
 
+    /* Remove the press marker after a while */
+    if (calib_area->press_time > 0)
+    {
+        calib_area->press_time -= time_step;
+        if (calib_area->press_time <= 0)
+            invalidate_press(calib_area);
+    }
+
     return true;
 }
 
+/* record a press as it comes in, rejected or not, as one of point 'k' */
+static void
+record_press(struct CalibArea *calib_area,
+             int               k,
+             int               x,
+             int               y)
+{
+    if (calib_area->record == NULL)
+        return;
+
+    if (!calib_area->record_started)
+        record_session(calib_area->record, calib_area->calibrator,
+                       calib_area->display_width, calib_area->display_height);
+    calib_area->record_started = true;
+    record_click(calib_area->record, grid_point(calib_area->calibrator, k), x, y);
+}
+
+/*
+ * all points pressed: go on to the preview or verification, or close the
+ * window; returns false if closed
+ */
+static bool
+clicks_done(struct CalibArea *calib_area)
+{
+    GtkWidget *parent;
+
+    /* video wall: on to the next tile */
+    if (calib_area->wall != NULL && calib_area->current_tile + 1 < calib_area->wall->num_tiles)
+    {
+        show_tile(calib_area, calib_area->current_tile + 1);
+        return true;
+    }
+
+    if (calib_area->calibrator->max_interval > 0 && !precise_enough(calib_area))
+    {
+        save_progress(calib_area);
+        draw_message(calib_area, "Not precise enough yet, press the points once more");
+        redraw(calib_area);
+        return true;
+    }
+
+    if (calib_area->calibrator->preview)
+    {
+        start_preview(calib_area);
+        return true;
+    }
+
+    if (calib_area->calibrator->verify)
+    {
+        start_verify(calib_area);
+        return true;
+    }
+
+    parent = gtk_widget_get_parent(calib_area->drawing_area);
+    if (parent)
+        gtk_widget_destroy(parent);
+    return false;
+}
+
+/* handle a click (in display coordinates), returns false once done */
 bool
-on_button_press_event(GtkWidget      *widget,
-                      GdkEventButton *event,
-                      gpointer        data)
+handle_click(struct CalibArea *calib_area,
+             int               x,
+             int               y)
 {
-    struct CalibArea *calib_area = (struct CalibArea*)data;
+    int num_clicks = calib_area->calibrator->num_clicks;
+    int num_dropped = calib_area->calibrator->num_dropped;
     bool success;
 
+    /* the result is shown, presses only move the preview */
+    if (calib_area->previewing)
+    {
+        preview_motion(calib_area, x, y);
+        return true;
+    }
+
+    /* calibrated, the presses are for the verification */
+    if (calib_area->verifying)
+    {
+        verify_click(calib_area, x, y);
+        return true;
+    }
+
+    /* Acknowledge it before anything else */
+    show_press(calib_area, x, y);
+
+    /* Record it as it comes in, rejected or not */
+    record_press(calib_area, num_clicks, x, y);
+
     /* Handle click */
     calib_area->time_elapsed = 0;
-    success = add_click(calib_area->calibrator, (int)event->x_root, (int)event->y_root);
+    success = add_click(calib_area->calibrator, x, y);
+    TRACE(TRACE_CLICK, x, y, success, calib_area->calibrator->num_clicks);
+
+    /* whenever the clicks change, for resuming after an interruption */
+    if (calib_area->calibrator->num_clicks != num_clicks ||
+        calib_area->calibrator->num_dropped != num_dropped)
+        save_progress(calib_area);
 
-    if (!success && calib_area->calibrator->num_clicks == 0)
+    /* time from showing the target to its accepted press */
+    if (success)
+    {
+        double now = g_timer_elapsed(calib_area->session_timer, NULL);
+        double t = now - calib_area->target_shown;
+
+        calib_area->target_time_sum += t;
+        if (t > calib_area->target_time_max)
+            calib_area->target_time_max = t;
+        calib_area->num_targets_timed++;
+        calib_area->target_shown = now;
+    }
+
+    if (!success && num_clicks > 0 && calib_area->calibrator->num_clicks == 0)
         draw_message(calib_area, "Mis-click detected, restarting...");
+    else if (!success && calib_area->calibrator->num_rejected > 0)
+        draw_message(calib_area, "Mis-click detected, press the point again");
+    else if (calib_area->calibrator->num_dropped != num_dropped)
+        draw_message(calib_area, "An earlier point was off, press it again");
     else
         draw_message(calib_area, NULL);
 
     /* Are we done yet? */
-    if (calib_area->calibrator->num_clicks >= 4)
+    if (calib_area->calibrator->num_clicks >= num_targets(calib_area->calibrator))
+        return clicks_done(calib_area);
+
+    /* Force a redraw */
+    redraw(calib_area);
+
+    return true;
+}
+
+/*
+ * Bootstrap confidence (--confidence): if an interval is wider than
+ * allowed, another round of the points is added and false returned.
+ */
+bool
+precise_enough(struct CalibArea *calib_area)
+{
+    struct Calib *c = calib_area->calibrator;
+    struct Confidence conf;
+    double widest;
+
+    if (!bootstrap(c, calib_area->display_width, calib_area->display_height,
+                   NUM_RESAMPLES, 0, &conf))
     {
-        GtkWidget *parent = gtk_widget_get_parent(calib_area->drawing_area);
-        if (parent)
-            gtk_widget_destroy(parent);
+        /* no calibration at all is for finish() to report */
+        if (conf.num_valid == 0)
+            return true;
+        widest = -1;
+        printf("Confidence: only %d of %d resamples give a calibration\n",
+               conf.num_valid, NUM_RESAMPLES);
+    }
+    else
+    {
+        widest = interval_pixels(&conf, calib_area->display_width, calib_area->display_height);
+        printf("Confidence (95%%): %d..%d, %d..%d, %d..%d, %d..%d, widest %.1f pixels\n",
+               conf.low.x_min, conf.high.x_min, conf.low.y_min, conf.high.y_min,
+               conf.low.x_max, conf.high.x_max, conf.low.y_max, conf.high.y_max, widest);
+        if (widest <= c->max_interval)
+            return true;
+    }
+
+    if (!add_round(c))
+    {
+        fprintf(stderr, "Warning: calibration not within %g pixels, but no room for more points\n", c->max_interval);
         return true;
     }
+    return false;
+}
 
-    /* Force a redraw */
+/* show the result, if there is one, and wait for the operator */
+void
+start_preview(struct CalibArea *calib_area)
+{
+    struct Calib *c = calib_area->calibrator;
+
+    if (!finish(c, calib_area->display_width, calib_area->display_height,
+                &calib_area->preview_axys, &calib_area->preview_swap))
+    {
+        reset(c);
+        save_progress(calib_area);
+        draw_message(calib_area, "No valid calibration, restarting...");
+        redraw(calib_area);
+        return;
+    }
+
+    calib_area->previewing = true;
+    calib_area->preview_shown = false;
+    calib_area->time_elapsed = 0;
+    draw_message(calib_area, "Preview: press Enter to accept, R to redo, any other key to abort");
+    redraw(calib_area);
+}
+
+/* calibrated: have the verification grid pressed with the result */
+void
+start_verify(struct CalibArea *calib_area)
+{
+    struct Calib *c = calib_area->calibrator;
+
+    if (!finish(c, calib_area->display_width, calib_area->display_height,
+                &calib_area->verify_axys, &calib_area->verify_swap))
+    {
+        reset(c);
+        save_progress(calib_area);
+        draw_message(calib_area, "No valid calibration, restarting...");
+        redraw(calib_area);
+        return;
+    }
+
+    verify_start(&calib_area->verify, calib_area->display_width, calib_area->display_height);
+    calib_area->verifying = true;
+    calib_area->time_elapsed = 0;
+    draw_message(calib_area, "Verification: press the points once more");
     redraw(calib_area);
+}
+
+/*
+ * A press of the verification, where it ends up with the new calibration
+ * is compared to its point. After the last one the heatmap and summary are
+ * shown, until a key is pressed or the timeout.
+ */
+void
+verify_click(struct CalibArea *calib_area,
+             int               x,
+             int               y)
+{
+    struct Verification *v = &calib_area->verify;
+    double new_x, new_y;
+    int offset_x = 0, offset_y = 0;
+
+    if (v->num_pressed == VERIFY_POINTS)
+        return;
+
+    show_press(calib_area, x, y);
+    calib_area->time_elapsed = 0;
+
+    recalibrate(calib_area->calibrator, &calib_area->verify_axys, calib_area->verify_swap,
+                calib_area->display_width, calib_area->display_height,
+                x, y, &new_x, &new_y);
+    to_window(calib_area, &offset_x, &offset_y);
+    if (!verify_press(v, calib_area->display_width, calib_area->display_height,
+                      new_x + offset_x, new_y + offset_y))
+    {
+        redraw(calib_area);
+        return;
+    }
+
+    printf("Verification: max error %.1f pixels (at %.0f, %.0f), mean %.1f pixels, worst region: %s\n",
+           v->max_error, v->target_x[v->worst_point], v->target_y[v->worst_point],
+           v->mean_error, v->worst_region);
+    g_snprintf(calib_area->verify_message, sizeof calib_area->verify_message,
+               "Max error %.1f px, mean %.1f px, worst: %s (any key to finish)",
+               v->max_error, v->mean_error, v->worst_region);
+    draw_message(calib_area, calib_area->verify_message);
+    redraw(calib_area);
+}
+
+/*
+ * Move the preview to a new position (in display coordinates). Only the
+ * old and new markers are invalidated; GDK merges those into one expose
+ * per frame, so however fast the events come, only the latest position is
+ * drawn and nothing queues up.
+ */
+void
+preview_motion(struct CalibArea *calib_area,
+               int               x,
+               int               y)
+{
+    double new_x, new_y;
+    int nx, ny;
+
+    if (!calib_area->previewing)
+        return;
+
+    recalibrate(calib_area->calibrator, &calib_area->preview_axys, calib_area->preview_swap,
+                calib_area->display_width, calib_area->display_height,
+                x, y, &new_x, &new_y);
+    nx = (int)(new_x + 0.5);
+    ny = (int)(new_y + 0.5);
+    to_window(calib_area, &x, &y);
+    to_window(calib_area, &nx, &ny);
+
+    if (calib_area->preview_shown)
+    {
+        invalidate_around(calib_area, calib_area->raw_x, calib_area->raw_y, press_radius + 1);
+        invalidate_around(calib_area, calib_area->new_x, calib_area->new_y, cross_lines + 1);
+    }
+    calib_area->raw_x = x;
+    calib_area->raw_y = y;
+    calib_area->new_x = nx;
+    calib_area->new_y = ny;
+    calib_area->preview_shown = true;
+    invalidate_around(calib_area, x, y, press_radius + 1);
+    invalidate_around(calib_area, nx, ny, cross_lines + 1);
+
+    calib_area->time_elapsed = 0;
+}
+
+bool
+on_motion_notify_event(GtkWidget      *widget,
+                       GdkEventMotion *event,
+                       gpointer        data)
+{
+    struct CalibArea *calib_area = (struct CalibArea*)data;
+
+    /* positions come straight from the event device instead */
+    if (calib_area->calibrator->evdev != NULL)
+        return true;
+
+#ifdef HAVE_XI22
+    /* once we get real touches, ignore the emulated pointer events */
+    if (calib_area->touch_seen)
+        return true;
+#endif
+
+    preview_motion(calib_area, (int)event->x_root, (int)event->y_root);
+
+    return true;
+}
+
+bool
+on_button_press_event(GtkWidget      *widget,
+                      GdkEventButton *event,
+                      gpointer        data)
+{
+    struct CalibArea *calib_area = (struct CalibArea*)data;
+
+    /* clicks come straight from the event device instead */
+    if (calib_area->calibrator->evdev != NULL)
+        return true;
+
+#ifdef HAVE_XI22
+    /* once we get real touches, ignore the emulated pointer events; and
+     * the device is not known yet from a core event */
+    if (calib_area->touch_seen || calib_area->calibrator->num_candidates > 0 ||
+        calib_area->one_shot || (calib_area->wall != NULL && calib_area->wall->c->num_candidates > 0))
+        return true;
+#endif
+
+    handle_click(calib_area, (int)event->x_root, (int)event->y_root);
 
     return true;
 }
 
+#ifdef HAVE_XI22
+/*
+ * Select the XI 2.2 touch events on the calibration window, so that we get
+ * the touches themselves instead of the server's pointer emulation of them.
+ * Returns false if the server does not support them.
+ */
+bool
+select_touch_events(struct CalibArea *calib_area)
+{
+    GdkWindow *win = gtk_widget_get_window(calib_area->drawing_area);
+    Display *display;
+    unsigned char bits[XIMaskLen(XI_LASTEVENT)];
+    XIEventMask mask;
+    int event, error;
+    int major = 2, minor = 2;
+
+    if (win == NULL)
+        return false;
+    display = GDK_WINDOW_XDISPLAY(win);
+
+    if (!XQueryExtension(display, "XInputExtension", &calib_area->xi_opcode, &event, &error) ||
+        XIQueryVersion(display, &major, &minor) != Success ||
+        major < 2 || (major == 2 && minor < 2))
+        return false;
+
+    /* begin, update and end can only be selected together */
+    memset(bits, 0, sizeof(bits));
+    XISetMask(bits, XI_TouchBegin);
+    XISetMask(bits, XI_TouchUpdate);
+    XISetMask(bits, XI_TouchEnd);
+
+    /* touch-to-select: presses of pens and single touch screens too, to
+     * know which device they come from */
+    if (calib_area->calibrator->num_candidates > 0 || calib_area->wall != NULL)
+        XISetMask(bits, XI_ButtonPress);
+    mask.deviceid = XIAllMasterDevices;
+    mask.mask_len = sizeof(bits);
+    mask.mask = bits;
+    if (XISelectEvents(display, GDK_WINDOW_XID(win), &mask, 1) != Success)
+        return false;
+
+    gdk_window_add_filter(NULL, on_touch_event, calib_area);
+    calib_area->touch_filter = true;
+    return true;
+}
+
+/*
+ * the start of a touch sequence (or a press, when selecting the device by
+ * touch) is a click, at its (unrounded) root position
+ */
+GdkFilterReturn
+on_touch_event(GdkXEvent *xevent,
+               GdkEvent  *event,
+               gpointer   data)
+{
+    struct CalibArea *calib_area = (struct CalibArea*)data;
+    XGenericEventCookie *cookie = &((XEvent*)xevent)->xcookie;
+    GdkWindow *win = gtk_widget_get_window(calib_area->drawing_area);
+    int device_id;
+
+    if (win == NULL || cookie->type != GenericEvent ||
+        cookie->display != GDK_WINDOW_XDISPLAY(win) ||
+        cookie->extension != calib_area->xi_opcode ||
+        !XGetEventData(cookie->display, cookie))
+        return GDK_FILTER_CONTINUE;
+
+    /* the filter sees the events of all windows: only those of ours */
+    if (((XIDeviceEvent*)cookie->data)->event != GDK_WINDOW_XID(win))
+    {
+        XFreeEventData(cookie->display, cookie);
+        return GDK_FILTER_CONTINUE;
+    }
+
+    if (calib_area->one_shot && !calib_area->previewing && !calib_area->verifying &&
+        (cookie->evtype == XI_TouchBegin || cookie->evtype == XI_TouchUpdate ||
+         cookie->evtype == XI_TouchEnd))
+    {
+        XIDeviceEvent *ev = (XIDeviceEvent*)cookie->data;
+
+        device_id = calib_area->calibrator->device_id;
+        if (device_id < 0 || ev->sourceid == device_id)
+        {
+            calib_area->touch_seen = true;
+            one_shot_touch(calib_area, cookie->evtype, ev->detail,
+                           (int)(ev->root_x + 0.5), (int)(ev->root_y + 0.5));
+        }
+    }
+    else if (cookie->evtype == XI_TouchBegin || cookie->evtype == XI_ButtonPress)
+    {
+        XIDeviceEvent *ev = (XIDeviceEvent*)cookie->data;
+
+        /* the first candidate to press is the device to calibrate */
+        if (calib_area->calibrator->num_candidates > 0)
+            select_device(calib_area, ev->sourceid);
+        else if (calib_area->wall != NULL && calib_area->calibrator->device_id < 0 &&
+                 calib_area->wall->c->num_candidates > 0)
+            select_tile_device(calib_area, ev->sourceid);
+        device_id = calib_area->calibrator->device_id;
+
+        /* only presses of the device being calibrated, if known */
+        if (calib_area->calibrator->num_candidates == 0 &&
+            (device_id < 0 || ev->sourceid == device_id))
+        {
+            if (cookie->evtype == XI_TouchBegin)
+                calib_area->touch_seen = true;
+            handle_click(calib_area, (int)(ev->root_x + 0.5), (int)(ev->root_y + 0.5));
+        }
+    }
+    else if (cookie->evtype == XI_TouchUpdate && calib_area->previewing)
+    {
+        XIDeviceEvent *ev = (XIDeviceEvent*)cookie->data;
+
+        device_id = calib_area->calibrator->device_id;
+        if (device_id < 0 || ev->sourceid == device_id)
+            preview_motion(calib_area, (int)(ev->root_x + 0.5), (int)(ev->root_y + 0.5));
+    }
+
+    XFreeEventData(cookie->display, cookie);
+    return GDK_FILTER_REMOVE;
+}
+
+/*
+ * One-shot: the points with touches assigned from touch 'from' on, to the
+ * least total squared distance (of all n! assignments, n is small); returns
+ * the lowest cost found, 'best' is the assignment with it
+ */
+static double
+assign_touches(struct CalibArea *calib_area,
+               int               from,
+               int               used,
+               double            cost,
+               int              *current,
+               int              *best,
+               double            best_cost)
+{
+    int n = calib_area->num_touches;
+    int t;
+
+    if (cost >= best_cost)
+        return best_cost;
+    if (from == n)
+    {
+        memcpy(best, current, n * sizeof(int));
+        return cost;
+    }
+
+    for (t = 0; t < n; t++)
+    {
+        int x = calib_area->touch_x[t];
+        int y = calib_area->touch_y[t];
+        double dx, dy;
+
+        if (used & (1 << t))
+            continue;
+        to_window(calib_area, &x, &y);
+        dx = x - calib_area->X[from];
+        dy = y - calib_area->Y[from];
+        current[from] = t;
+        best_cost = assign_touches(calib_area, from + 1, used | (1 << t),
+                                   cost + dx * dx + dy * dy, current, best, best_cost);
+    }
+    return best_cost;
+}
+
+/*
+ * One-shot (--one-shot): the points are touched at once. The touches are
+ * followed until there is one for each point; then each point gets the
+ * touch nearest to it (in the current calibration, so that must not be
+ * swapped or inverted) as its click, and the calibration is done.
+ */
+void
+one_shot_touch(struct CalibArea *calib_area,
+               int               evtype,
+               int               touch_id,
+               int               x,
+               int               y)
+{
+    struct Calib *c = calib_area->calibrator;
+    int touch_of[ONE_SHOT_TOUCHES], current[ONE_SHOT_TOUCHES];
+    int n = calib_area->num_touches;
+    int i, k;
+
+    for (i = 0; i < n; i++)
+        if (calib_area->touch_id[i] == touch_id)
+            break;
+
+    /* lifted before all were down: forget it */
+    if (evtype == XI_TouchEnd)
+    {
+        if (i < n)
+        {
+            calib_area->num_touches--;
+            calib_area->touch_id[i] = calib_area->touch_id[n - 1];
+            calib_area->touch_x[i] = calib_area->touch_x[n - 1];
+            calib_area->touch_y[i] = calib_area->touch_y[n - 1];
+        }
+        return;
+    }
+
+    /* a new one (those of an earlier gesture are not followed) */
+    if (i == n)
+    {
+        if (evtype != XI_TouchBegin || n == ONE_SHOT_TOUCHES)
+            return;
+        calib_area->touch_id[i] = touch_id;
+        calib_area->num_touches++;
+        show_press(calib_area, x, y);
+        calib_area->time_elapsed = 0;
+    }
+    calib_area->touch_x[i] = x;
+    calib_area->touch_y[i] = y;
+
+    if (calib_area->num_touches < num_points(c))
+        return;
+
+    assign_touches(calib_area, 0, 0, 0, current, touch_of, DBL_MAX);
+    calib_area->num_touches = 0;
+
+    /* the clicks of the gesture, all of them or none */
+    reset(c);
+    for (k = 0; k < num_targets(c); k++)
+    {
+        int t = touch_of[grid_point(c, k)];
+
+        record_press(calib_area, k, calib_area->touch_x[t], calib_area->touch_y[t]);
+        if (!add_click(c, calib_area->touch_x[t], calib_area->touch_y[t]) ||
+            c->num_clicks != k + 1)
+            break;
+    }
+    if (c->num_clicks < num_targets(c))
+    {
+        reset(c);
+        draw_message(calib_area, "Mis-touch detected, touch all points at once again");
+        redraw(calib_area);
+        return;
+    }
+
+    draw_message(calib_area, NULL);
+    if (clicks_done(calib_area))
+        redraw(calib_area);
+}
+
+/*
+ * Video wall: overlay 'device_id' is the one of the current tile, if it is
+ * one of the candidates and not of another tile. Returns false if not.
+ */
+bool
+select_tile_device(struct CalibArea *calib_area,
+                   int               device_id)
+{
+    struct Wall *wall = calib_area->wall;
+    struct Calib *c = wall->c;
+    struct Calib *tile = calib_area->calibrator;
+    int i, t;
+
+    for (i = 0; i < c->num_candidates; i++)
+        if (c->candidate_id[i] == device_id)
+            break;
+    if (i == c->num_candidates)
+        return false;
+    for (t = 0; t < wall->num_tiles; t++)
+        if (wall->tile[t]->device_id == device_id)
+        {
+            draw_message(calib_area, "That overlay is of another tile, press the points of this one");
+            redraw(calib_area);
+            return false;
+        }
+
+    tile->device_id = device_id;
+    tile->old_axys = c->candidate_axys[i];
+    tile->device_name = (char*)malloc(strlen(c->candidate_name[i]) + 1);
+    if (tile->device_name != NULL)
+        strcpy(tile->device_name, c->candidate_name[i]);
+    /* no matrix: the clicks are as they come (the identity) */
+    calib_get_matrix(c->display_name, device_id, tile->old_matrix);
+    printf("Tile %d: device \"%s\" id=%i\n", calib_area->current_tile + 1,
+           c->candidate_name[i], device_id);
+    draw_message(calib_area, calib_area->tile_message);
+
+    return true;
+}
+
+/*
+ * Touch-to-select: calibrate device 'device_id' if it is one of the
+ * candidates, with its current calibration. Returns false if it is not.
+ */
+bool
+select_device(struct CalibArea *calib_area,
+              int               device_id)
+{
+    struct Calib *c = calib_area->calibrator;
+    int swap_xy, invert_x, invert_y;
+    int i;
+
+    for (i = 0; i < c->num_candidates; i++)
+        if (c->candidate_id[i] == device_id)
+            break;
+    if (i == c->num_candidates)
+        return false;
+
+    c->device_id = device_id;
+    c->old_axys = c->candidate_axys[i];
+    /* not those of the device given at the start: none, unless it says */
+    c->old_swap_xy = false;
+    c->old_invert_x = false;
+    c->old_invert_y = false;
+    if (calib_get_driver_state(c->display_name, device_id, &swap_xy, &invert_x, &invert_y))
+    {
+        c->old_swap_xy = swap_xy;
+        c->old_invert_x = invert_x;
+        c->old_invert_y = invert_y;
+    }
+    printf("Calibrating device \"%s\" id=%i (selected by touch)\n", c->candidate_name[i], device_id);
+    printf("Current calibration: %d, %d, %d, %d\n",
+           c->old_axys.x_min, c->old_axys.y_min, c->old_axys.x_max, c->old_axys.y_max);
+
+    /* its name is the device's now */
+    free(c->device_name);
+    c->device_name = c->candidate_name[i];
+    c->candidate_name[i] = NULL;
+    for (i = 0; i < c->num_candidates; i++)
+        free(c->candidate_name[i]);
+    c->num_candidates = 0;
+    draw_message(calib_area, NULL);
+
+    return true;
+}
+#endif
+
+#ifdef HAVE_LINUX_INPUT_H
+/*
+ * Events from the event device: presses are in device coordinates, which
+ * are scaled to the display with old_axys (the range of the device), so
+ * finish() returns them in device coordinates again.
+ */
+gboolean
+on_evdev_event(GIOChannel   *source,
+               GIOCondition  condition,
+               gpointer      data)
+{
+    struct CalibArea *calib_area = (struct CalibArea*)data;
+    struct input_event ev[64];
+    int n, i;
+
+    n = read_events(g_io_channel_unix_get_fd(source), ev, 64);
+    if (n < 0 && errno == EINTR)
+        return true;
+    if (n <= 0)
+    {
+        calib_area->evdev_watch = 0;
+        return false;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (track_touch(&calib_area->touch, &ev[i]))
+        {
+            int x, y;
+            scale_touch(&calib_area->calibrator->old_axys,
+                        calib_area->display_width, calib_area->display_height,
+                        &calib_area->touch, &x, &y);
+            if (!handle_click(calib_area, x, y))
+            {
+                calib_area->evdev_watch = 0;
+                return false;
+            }
+        }
+    }
+
+    /* the preview follows the touch, once per batch of events */
+    if (calib_area->previewing && calib_area->touch.down)
+    {
+        int x, y;
+        scale_touch(&calib_area->calibrator->old_axys,
+                    calib_area->display_width, calib_area->display_height,
+                    &calib_area->touch, &x, &y);
+        preview_motion(calib_area, x, y);
+    }
+
+    return true;
+}
+#endif
+
 void
 draw_message(struct CalibArea *calib_area,
              const char       *msg)
@@ -350,24 +1375,55 @@ on_key_press_event(GtkWidget   *widget,
 {
     struct CalibArea *calib_area = (struct CalibArea*)data;
     GtkWidget *parent = gtk_widget_get_parent(calib_area->drawing_area);
+
+    if (calib_area->previewing)
+    {
+        /* redo: start over */
+        if (event->keyval == GDK_KEY_r || event->keyval == GDK_KEY_R)
+        {
+            calib_area->previewing = false;
+            reset(calib_area->calibrator);
+            save_progress(calib_area);
+            draw_message(calib_area, NULL);
+            redraw(calib_area);
+            return true;
+        }
+
+        /* anything but accepting aborts: no result */
+        if (event->keyval != GDK_KEY_Return && event->keyval != GDK_KEY_KP_Enter)
+            reset(calib_area->calibrator);
+    }
+
     if (parent)
         gtk_widget_destroy(parent);
     return true;
 }
 
+/* nr of calibration windows still open, gtk_main() ends with the last one */
+static int open_windows = 0;
+
+void
+on_window_destroy(GtkWidget *widget,
+                  gpointer   data)
+{
+    if (--open_windows == 0)
+        gtk_main_quit();
+}
+
 /**
- * Creates the windows and other objects required to do calibration
- * under GTK and then starts the main loop. When the main loop exits,
- * the calibration will be calculated (if possible) and this function
- * will then return ('true' if successful, 'false' otherwise).
+ * Creates the window and other objects required to do calibration under GTK,
+ * on the display of the calibrator (the default one if not set).
+ * Returns NULL if that is not possible.
  */
-bool
-run_gui(struct Calib *c,
-        XYinfo       *new_axys,
-        bool         *swap)
+struct CalibArea*
+create_gui(struct Calib *c)
 {
-    bool success;
-    struct CalibArea *calib_area = CalibrationArea_(c);
+    struct CalibArea *calib_area;
+    GdkScreen *screen;
+    GtkWidget *win;
+    GdkDisplay *display = NULL;
+    int monitor = c->monitor;
+    int width_mm;
 
     printf("Current calibration: %d, %d, %d, %d\n",
            c->old_axys.x_min, 
@@ -375,18 +1431,87 @@ run_gui(struct Calib *c,
            c->old_axys.x_max, 
            c->old_axys.y_max);
 
-    GdkScreen *screen = gdk_screen_get_default();
-    GtkWidget *win = gtk_window_new(GTK_WINDOW_TOPLEVEL);
-    GdkRectangle rect;
-    /*int num_monitors = screen->get_n_monitors(); TODO, multiple monitors?*/
+    if (c->display_name != NULL)
+    {
+        display = gdk_display_open(c->display_name);
+        if (display == NULL)
+        {
+            fprintf(stderr, "Error: unable to open display '%s'\n", c->display_name);
+            return NULL;
+        }
+        screen = gdk_display_get_default_screen(display);
+    }
+    else
+        screen = gdk_screen_get_default();
+
+    calib_area = CalibrationArea_(c);
+    calib_area->screen = screen;
+    calib_area->display = display;
+    calib_area->session_timer = g_timer_new();
+
+    if (c->record_file != NULL)
+    {
+        calib_area->record = fopen(c->record_file, "w");
+        if (calib_area->record == NULL)
+        {
+            fprintf(stderr, "Error: unable to write recording to '%s'\n", c->record_file);
+            free_gui(calib_area);
+            return NULL;
+        }
+    }
+
+#ifdef HAVE_LINUX_INPUT_H
+    /* read the clicks from the event device, grabbed so X does not see them */
+    if (c->evdev != NULL)
+    {
+        int fd = open_evdev(c->evdev, true);
+        if (fd < 0)
+        {
+            fprintf(stderr, "Error: unable to open '%s': %s\n", c->evdev, strerror(errno));
+            free_gui(calib_area);
+            return NULL;
+        }
+        calib_area->channel = g_io_channel_unix_new(fd);
+        g_io_channel_set_close_on_unref(calib_area->channel, TRUE);
+        calib_area->evdev_watch = g_io_add_watch(calib_area->channel,
+                G_IO_IN | G_IO_HUP | G_IO_ERR, on_evdev_event, calib_area);
+    }
+#endif
 
-    g_signal_connect(G_OBJECT(win), "destroy", G_CALLBACK(gtk_main_quit), NULL);
+    if (monitor < 0 || monitor >= gdk_screen_get_n_monitors(screen))
+    {
+        fprintf(stderr, "Warning: no monitor %d, using monitor 0\n", monitor);
+        monitor = 0;
+    }
+    gdk_screen_get_monitor_geometry(screen, monitor, &calib_area->monitor);
 
-    gdk_screen_get_monitor_geometry(screen, 0, &rect);
+    /* resolution of the monitor, for the thresholds */
+    width_mm = gdk_screen_get_monitor_width_mm(screen, monitor);
+    if (width_mm > 0)
+        c->px_per_mm = calib_area->monitor.width / (float)width_mm;
+    TRACE(TRACE_RESOLUTION, c->px_per_mm, misclick_threshold(c), doubleclick_threshold(c), 0);
+
+    /* video wall: the tiles take their settings from here */
+    if (c->wall_cols > 0)
+    {
+        calib_area->wall = new_wall(c);
+        if (calib_area->wall == NULL)
+        {
+            fprintf(stderr, "Error: out of memory for the tiles\n");
+            free_gui(calib_area);
+            return NULL;
+        }
+        set_display_size(calib_area, calib_area->display_width, calib_area->display_height);
+    }
+
+    win = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_screen(GTK_WINDOW(win), screen);
+    open_windows++;
+    g_signal_connect(G_OBJECT(win), "destroy", G_CALLBACK(on_window_destroy), NULL);
 
     /* when no window manager: explicitely take size of full screen */
-    gtk_window_move(GTK_WINDOW(win), rect.x, rect.y);
-    gtk_window_set_default_size(GTK_WINDOW(win), rect.width, rect.height);
+    gtk_window_move(GTK_WINDOW(win), calib_area->monitor.x, calib_area->monitor.y);
+    gtk_window_set_default_size(GTK_WINDOW(win), calib_area->monitor.width, calib_area->monitor.height);
 
     /* in case of window manager: set as full screen to hide window decorations */
     gtk_window_fullscreen(GTK_WINDOW(win));
@@ -394,18 +1519,252 @@ run_gui(struct Calib *c,
     gtk_container_add(GTK_CONTAINER(win), calib_area->drawing_area);
     gtk_widget_show_all(win);
 
-    printf("gtk_main entered!\n");
-    gtk_main();
-    printf("gtk_main returned!\n");
+#ifdef HAVE_XI22
+    /* touchscreens: use the touches, not the emulated button presses */
+    if (c->evdev == NULL && select_touch_events(calib_area))
+        calib_area->one_shot = c->one_shot;
+    else if (calib_area->wall != NULL)
+        fprintf(stderr, "Warning: no touch events (XI 2.2) to tell the overlays of the tiles apart\n");
+    else if (c->num_candidates > 0)
+    {
+        fprintf(stderr, "Warning: unable to select the device by touch, calibrating the last one\n");
+        select_device(calib_area, c->candidate_id[c->num_candidates - 1]);
+    }
+    else if (c->one_shot)
+        fprintf(stderr, "Warning: no touch events (XI 2.2), press the points one by one\n");
+    if (c->num_candidates > 0 && calib_area->wall == NULL)
+        draw_message(calib_area, "Press the point with the device to calibrate");
+    else if (calib_area->one_shot && c->num_clicks == 0)
+        draw_message(calib_area, "Touch all points at once");
+#endif
+
+    return calib_area;
+}
+
+/* header and value of a metric, with a '.' whatever the locale */
+static void
+print_metric(FILE       *f,
+             const char *name,
+             const char *type,
+             const char *help,
+             double      value)
+{
+    char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+    fprintf(f, "# HELP %s %s\n", name, help);
+    fprintf(f, "# TYPE %s %s\n", name, type);
+    fprintf(f, "%s %s\n", name, g_ascii_formatd(buf, sizeof(buf), "%.6g", value));
+}
+
+/*
+ * Write the metrics of the session to 'filename' in the Prometheus text
+ * format (e.g. for node_exporter's textfile collector). It is written to a
+ * temporary file first and renamed, so it is never read half-written.
+ */
+bool
+write_metrics(struct CalibArea *calib_area,
+              const char       *filename,
+              bool              success)
+{
+    struct Calib *c = calib_area->calibrator;
+    char buf[G_ASCII_DTOSTR_BUF_SIZE];
+    char *tmp;
+    FILE *f;
+
+    f = open_replacement(filename, &tmp);
+    if (f == NULL)
+        return false;
+
+    print_metric(f, "xinput_calibrator_clicks_total", "counter",
+                 "Presses given to the calibration.", c->count_clicks);
+    fprintf(f, "# HELP xinput_calibrator_rejected_clicks_total Presses rejected, by reason.\n");
+    fprintf(f, "# TYPE xinput_calibrator_rejected_clicks_total counter\n");
+    fprintf(f, "xinput_calibrator_rejected_clicks_total{reason=\"doubleclick\"} %d\n", c->count_doubleclicks);
+    fprintf(f, "xinput_calibrator_rejected_clicks_total{reason=\"misclick\"} %d\n", c->count_misclicks);
+    print_metric(f, "xinput_calibrator_resets_total", "counter",
+                 "Restarts of the calibration.", c->count_resets);
+    print_metric(f, "xinput_calibrator_dropped_clicks_total", "counter",
+                 "Earlier presses found off and pressed again.", c->num_dropped);
+
+    fprintf(f, "# HELP xinput_calibrator_target_seconds Time from showing a target to its accepted press.\n");
+    fprintf(f, "# TYPE xinput_calibrator_target_seconds summary\n");
+    fprintf(f, "xinput_calibrator_target_seconds_sum %s\n",
+            g_ascii_formatd(buf, sizeof(buf), "%.6g", calib_area->target_time_sum));
+    fprintf(f, "xinput_calibrator_target_seconds_count %d\n", calib_area->num_targets_timed);
+    print_metric(f, "xinput_calibrator_target_max_seconds", "gauge",
+                 "Longest time a target took.", calib_area->target_time_max);
+
+    print_metric(f, "xinput_calibrator_timeouts_total", "counter",
+                 "Sessions ended by the timeout.", calib_area->timed_out);
+    print_metric(f, "xinput_calibrator_session_duration_seconds", "gauge",
+                 "Duration of the session.", g_timer_elapsed(calib_area->session_timer, NULL));
+    print_metric(f, "xinput_calibrator_session_success", "gauge",
+                 "Whether the session gave a calibration.", success);
+
+    return replace_file(f, tmp, filename);
+}
+
+/*
+ * Free the calibration area, and all create_gui() set up for it: its
+ * event sources, timers, files and the display it opened. The window is
+ * gone by now, or was never created.
+ */
+void
+free_gui(struct CalibArea *calib_area)
+{
+    if (calib_area->timer_source != 0)
+        g_source_remove(calib_area->timer_source);
+#ifdef HAVE_XI22
+    if (calib_area->touch_filter)
+        gdk_window_remove_filter(NULL, on_touch_event, calib_area);
+#endif
+    free_wall(calib_area->wall);
+#ifdef HAVE_LINUX_INPUT_H
+    if (calib_area->evdev_watch != 0)
+        g_source_remove(calib_area->evdev_watch);
+    if (calib_area->channel != NULL)
+        g_io_channel_unref(calib_area->channel);
+#endif
+    if (calib_area->session_timer != NULL)
+        g_timer_destroy(calib_area->session_timer);
+    if (calib_area->record != NULL)
+        fclose(calib_area->record);
+
+    g_object_unref(calib_area->drawing_area);
+    if (calib_area->display != NULL)
+        gdk_display_close(calib_area->display);
+    free(calib_area);
+}
+
+/**
+ * After the main loop: calculates the calibration (if possible) and
+ * returns 'true' if successful, 'false' otherwise. Frees calib_area.
+ */
+bool
+finish_gui(struct CalibArea *calib_area,
+           XYinfo           *new_axys,
+           bool             *swap)
+{
+    struct Calib *c = calib_area->calibrator;
+    bool success;
+
+    /* aborted before any device pressed */
+    while (c->num_candidates > 0)
+        free(c->candidate_name[--c->num_candidates]);
 
     success = finish(calib_area->calibrator, calib_area->display_width, calib_area->display_height, new_axys, swap);
 
+    /* the matrix is relative to the whole screen: add the monitor's offset */
+    if (success && c->use_matrix)
+    {
+        double root_x[MAX_POINTS], root_y[MAX_POINTS];
+        int i;
+
+        for (i = 0; i < num_points(c); i++)
+        {
+            root_x[i] = calib_area->monitor.x + calib_area->X[i];
+            root_y[i] = calib_area->monitor.y + calib_area->Y[i];
+        }
+        success = finish_matrix(c, root_x, root_y,
+                gdk_screen_get_width(calib_area->screen),
+                gdk_screen_get_height(calib_area->screen));
+    }
+
+    /* non-linear correction on top of the current calibration */
+    if (success && c->correction_file != NULL)
+    {
+        struct Correction *cor = fit_correction(c, calib_area->X, calib_area->Y,
+                calib_area->display_width, calib_area->display_height);
+        if (cor == NULL || !save_correction(cor, c->correction_file))
+        {
+            fprintf(stderr, "Error: unable to write correction grid to '%s'\n", c->correction_file);
+            success = false;
+        }
+        else
+            printf("Correction grid written to '%s'\n", c->correction_file);
+        free_correction(cor);
+    }
+
     printf("Final calibration: %d, %d, %d, %d\n",
            new_axys->x_min, 
            new_axys->y_min, 
            new_axys->x_max, 
            new_axys->y_max);
 
+    /* nothing left to resume */
+    if (success && c->checkpoint_file != NULL)
+        remove(c->checkpoint_file);
+
+    if (c->metrics_file != NULL && !write_metrics(calib_area, c->metrics_file, success))
+        fprintf(stderr, "Error: unable to write metrics to '%s'\n", c->metrics_file);
+
+    free_gui(calib_area);
+
    return success;
 }
 
+/**
+ * Creates the windows and other objects required to do calibration
+ * under GTK and then starts the main loop. When the main loop exits,
+ * the calibration will be calculated (if possible) and this function
+ * will then return ('true' if successful, 'false' otherwise).
+ */
+bool
+run_gui(struct Calib *c,
+        XYinfo       *new_axys,
+        bool         *swap)
+{
+    struct CalibArea *calib_area = create_gui(c);
+    if (calib_area == NULL)
+        return false;
+
+    TRACE(TRACE_GTK_MAIN, 0, 0, 0, 0);
+    gtk_main();
+    TRACE(TRACE_GTK_MAIN_DONE, 0, 0, 0, 0);
+
+    return finish_gui(calib_area, new_axys, swap);
+}
+
+/**
+ * Video wall: creates the window and runs the main loop, then solves the
+ * tiles (see wall.h). Returns the wall, or NULL if not all of its tiles
+ * could be calibrated.
+ */
+struct Wall*
+run_wall(struct Calib *c)
+{
+    struct CalibArea *calib_area = create_gui(c);
+    struct Wall *wall;
+    int screen_width, screen_height;
+    int t;
+
+    if (calib_area == NULL)
+        return NULL;
+
+    TRACE(TRACE_GTK_MAIN, 0, 0, 0, 0);
+    gtk_main();
+    TRACE(TRACE_GTK_MAIN_DONE, 0, 0, 0, 0);
+
+    /* the wall outlives the window */
+    wall = calib_area->wall;
+    calib_area->wall = NULL;
+    calib_area->calibrator = c;
+    screen_width = gdk_screen_get_width(calib_area->screen);
+    screen_height = gdk_screen_get_height(calib_area->screen);
+    free_gui(calib_area);
+
+    for (t = 0; t < wall->num_tiles; t++)
+        if (c->num_candidates > 0 && wall->tile[t]->device_id < 0)
+        {
+            fprintf(stderr, "Error: no overlay pressed the points of tile %d\n", t + 1);
+            free_wall(wall);
+            return NULL;
+        }
+
+    if (!solve_wall(wall, screen_width, screen_height))
+    {
+        free_wall(wall);
+        return NULL;
+    }
+    return wall;
+}
@@ -25,19 +25,107 @@
 #define _gui_gtk_h
 
 #include <gtk/gtk.h>
+#ifdef HAVE_XI22
+#include <gdk/gdkx.h>
+#endif
 
 #include "calibrator.h"
+#include "record.h"
+#include "verify.h"
+#include "wall.h"
+#ifdef HAVE_LINUX_INPUT_H
+#include "evdev.h"
+#endif
 
 struct CalibArea
 {
     struct Calib* calibrator;
-    double X[4], Y[4];
+    double X[MAX_POINTS], Y[MAX_POINTS];
     int display_width, display_height;
     int time_elapsed;
 
     const char* message;
 
     GtkWidget *drawing_area;
+
+    /* screen and monitor the window is on, and the display if it was
+     * opened for it */
+    GdkScreen *screen;
+    GdkRectangle monitor;
+    GdkDisplay *display;
+
+    /* the animation timer (0 once it stopped) */
+    guint timer_source;
+
+    /* marker at the last press, painted right away (ms left to show it) */
+    int press_x, press_y;
+    int press_time;
+
+    /* the press is shown by the marker, the full redraw is still to be
+     * traced; when the press came (on the session timer), to trace the
+     * time to each */
+    bool press_pending;
+    double press_start;
+
+    /* preview of the result (--preview): the last position, as it is
+     * now and as it will be, in window coordinates */
+    bool previewing;
+    XYinfo preview_axys;
+    bool preview_swap;
+    bool preview_shown;
+    int raw_x, raw_y;
+    int new_x, new_y;
+
+    /* verification (--verify): the calibration it is of, and the presses
+     * of its grid; the summary to show once all are pressed */
+    bool verifying;
+    XYinfo verify_axys;
+    bool verify_swap;
+    struct Verification verify;
+    char verify_message[128];
+
+    /* video wall (--wall): the tiles, and the one being calibrated (its
+     * calibrator is 'calibrator' meanwhile) */
+    struct Wall *wall;
+    int current_tile;
+    char tile_message[64];
+
+    /* recording of the clicks (--record) */
+    FILE *record;
+    bool record_started;
+
+    /* metrics of the session (--metrics-file): its time so far, when the
+     * current target was shown, and the time the targets took (s) */
+    GTimer *session_timer;
+    double target_shown;
+    double target_time_sum;
+    double target_time_max;
+    int num_targets_timed;
+    bool timed_out;
+
+#ifdef HAVE_XI22
+    /* native touch events (XI 2.2), through a filter of all events
+     * (GDK does not pass XI 2 events to the filters of a window) */
+    int xi_opcode;
+    bool touch_filter;
+    bool touch_seen;
+
+    /* one-shot: the touches down (ids and root positions), until there
+     * is one for each point */
+    int num_touches;
+    int touch_id[ONE_SHOT_TOUCHES];
+    int touch_x[ONE_SHOT_TOUCHES], touch_y[ONE_SHOT_TOUCHES];
+#endif
+
+    /* all points touched at once (--one-shot, with touch events) */
+    bool one_shot;
+
+#ifdef HAVE_LINUX_INPUT_H
+    /* direct input from the event device */
+    GIOChannel *channel;
+    guint evdev_watch;
+    struct Touch touch;
+#endif
 };
 
 struct CalibArea* CalibrationArea_      (struct Calib     *c);
@@ -52,17 +140,66 @@ void              draw                  (GtkWidget        *widget,
                                          cairo_t          *cr,
                                          gpointer          data);
 void              redraw                (struct CalibArea *calib_area);
+void              show_press            (struct CalibArea *calib_area,
+                                         int               x,
+                                         int               y);
 bool              on_timer_signal       (struct CalibArea *calib_area);
+bool              handle_click          (struct CalibArea *calib_area,
+                                         int               x,
+                                         int               y);
+bool              precise_enough        (struct CalibArea *calib_area);
+void              start_preview         (struct CalibArea *calib_area);
+void              preview_motion        (struct CalibArea *calib_area,
+                                         int               x,
+                                         int               y);
+void              start_verify          (struct CalibArea *calib_area);
+void              verify_click          (struct CalibArea *calib_area,
+                                         int               x,
+                                         int               y);
+bool              on_motion_notify_event(GtkWidget        *widget,
+                                         GdkEventMotion   *event,
+                                         gpointer          data);
 bool              on_button_press_event (GtkWidget        *widget,
                                          GdkEventButton   *event,
                                          gpointer          data);
 void              draw_message          (struct CalibArea *calib_area,
                                          const char       *msg);
+#ifdef HAVE_XI22
+bool              select_touch_events   (struct CalibArea *calib_area);
+GdkFilterReturn   on_touch_event        (GdkXEvent        *xevent,
+                                         GdkEvent         *event,
+                                         gpointer          data);
+bool              select_device         (struct CalibArea *calib_area,
+                                         int               device_id);
+bool              select_tile_device    (struct CalibArea *calib_area,
+                                         int               device_id);
+void              one_shot_touch        (struct CalibArea *calib_area,
+                                         int               evtype,
+                                         int               touch_id,
+                                         int               x,
+                                         int               y);
+#endif
+#ifdef HAVE_LINUX_INPUT_H
+gboolean          on_evdev_event        (GIOChannel       *source,
+                                         GIOCondition      condition,
+                                         gpointer          data);
+#endif
 bool              on_key_press_event    (GtkWidget        *widget,
                                          GdkEventKey      *event,
                                          gpointer          data);
+void              on_window_destroy     (GtkWidget        *widget,
+                                         gpointer          data);
+struct CalibArea* create_gui            (struct Calib     *c);
+bool              write_metrics         (struct CalibArea *calib_area,
+                                         const char       *filename,
+                                         bool              success);
+void              free_gui              (struct CalibArea *calib_area);
+bool              finish_gui            (struct CalibArea *calib_area,
+                                         XYinfo           *new_axys,
+                                         bool             *swap);
 bool              run_gui               (struct Calib     *c,
                                          XYinfo           *new_axys,
                                          bool             *swap);
+struct Wall*      run_wall              (struct Calib     *c);
 
 #endif /* _gui_gtk_h */
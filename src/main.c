@@ -25,149 +25,61 @@
 #include <ctype.h>
 #include <string.h>
 #include <dirent.h>
+#include <unistd.h>
 
 #include <X11/extensions/XInput.h>
 
 #include "gui_gtk.h"
 #include "main.h"
-
-/**
- * find a calibratable touchscreen device (using XInput)
- *
- * if pre_device is NULL, the last calibratable device is selected.
- * retuns number of devices found,
- * the data of the device is returned in the last 3 function parameters
- */
-int find_device(const char* pre_device, bool verbose, bool list_devices,
-        XID* device_id, const char** device_name, XYinfo* device_axys)
-{
-    bool pre_device_is_id = true;
-    int found = 0;
-
-    Display* display = XOpenDisplay(NULL);
-    if (display == NULL) {
-        fprintf(stderr, "Unable to connect to X server\n");
-        exit(1);
-    }
-
-    int xi_opcode, event, error;
-    if (!XQueryExtension(display, "XInputExtension", &xi_opcode, &event, &error)) {
-        fprintf(stderr, "X Input extension not available.\n");
-        exit(1);
-    }
-
-    /* verbose, get Xi version */
-    if (verbose) {
-        XExtensionVersion *version = XGetExtensionVersion(display, INAME);
-
-        if (version && (version != (XExtensionVersion*) NoSuchExtension)) {
-            printf("DEBUG: %s version is %i.%i\n",
-                INAME, version->major_version, version->minor_version);
-            XFree(version);
-        }
-    }
-
-    if (pre_device != NULL) {
-        /* check whether the pre_device is an ID (only digits) */
-        int len = strlen(pre_device);
-        int loop;
-        for (loop=0; loop<len; loop++) {
-	        if (!isdigit(pre_device[loop])) {
-	            pre_device_is_id = false;
-	            break;
-	        }
-        }
-    }
-
-
-    if (verbose)
-        printf("DEBUG: Skipping virtual master devices and devices without axis valuators.\n");
-    int ndevices;
-    XDeviceInfoPtr list, slist;
-    slist=list=(XDeviceInfoPtr) XListInputDevices (display, &ndevices);
-    int i;
-    for (i=0; i<ndevices; i++, list++)
-    {
-        if (list->use == IsXKeyboard || list->use == IsXPointer) /* virtual master device */
-            continue;
-
-        /* if we are looking for a specific device */
-        if (pre_device != NULL) {
-            if ((pre_device_is_id && list->id == (XID) atoi(pre_device)) ||
-                (!pre_device_is_id && strcmp(list->name, pre_device) == 0)) {
-                /* OK, fall through */
-            } else {
-                /* skip, not this device */
-                continue;
-            }
-        }
-
-        XAnyClassPtr any = (XAnyClassPtr) (list->inputclassinfo);
-        int j;
-        for (j=0; j<list->num_classes; j++)
-        {
-
-            if (any->class == ValuatorClass)
-            {
-                XValuatorInfoPtr V = (XValuatorInfoPtr) any;
-                XAxisInfoPtr ax = (XAxisInfoPtr) V->axes;
-
-                if (V->mode != Absolute) {
-                    if (verbose)
-                        printf("DEBUG: Skipping device '%s' id=%i, does not report Absolute events.\n",
-                            list->name, (int)list->id);
-                } else if (V->num_axes < 2 ||
-                    (ax[0].min_value == -1 && ax[0].max_value == -1) ||
-                    (ax[1].min_value == -1 && ax[1].max_value == -1)) {
-                    if (verbose)
-                        printf("DEBUG: Skipping device '%s' id=%i, does not have two calibratable axes.\n",
-                            list->name, (int)list->id);
-                } else {
-                    /* a calibratable device (has 2 axis valuators) */
-                    found++;
-                    *device_id = list->id;
-                    *device_name = my_strdup(list->name);
-                    device_axys->x_min = ax[0].min_value;
-                    device_axys->x_max = ax[0].max_value;
-                    device_axys->y_min = ax[1].min_value;
-                    device_axys->y_max = ax[1].max_value;
-
-                    if (list_devices)
-                        printf("Device \"%s\" id=%i\n", *device_name, (int)*device_id);
-                }
-
-            }
-
-            /*
-             * Increment 'any' to point to the next item in the linked
-             * list.  The length is in bytes, so 'any' must be cast to
-             * a character pointer before being incremented.
-             */
-            any = (XAnyClassPtr) ((char *) any + any->length);
-        }
-
-    }
-    XFreeDeviceList(slist);
-    XCloseDisplay(display);
-
-    return found;
-}
+#include "soak.h"
+#include "trace.h"
+#include "wall.h"
+#ifdef HAVE_LINUX_INPUT_H
+#include "evdev.h"
+#endif
 
 static void usage(char* cmd, unsigned thr_misclick)
 {
-    fprintf(stderr, "Usage: %s [-h|--help] [-v|--verbose] [--list] [--device <device name or id>] [--precalib <minx> <maxx> <miny> <maxy>] [--misclick <nr of pixels>] [--output-type <auto|xorg.conf.d|hal|xinput>] [--fake] [--geometry <w>x<h>]\n", cmd);
+    fprintf(stderr, "Usage: %s [-h|--help] [-v|--verbose] [--list] [--device <device name or id>] [--precalib <minx> <maxx> <miny> <maxy>] [--misclick <nr of pixels>] [--output-type <auto|xorg.conf.d|hal|xinput>] [--fake] [--geometry <w>x<h>] [--grid <cols>x<rows>] [--adaptive <nr of pixels>] [--confidence <nr of pixels>] [--correction <file>] [--record <file>] [--metrics-file <file>] [--checkpoint <file>] [--trace <file>]", cmd);
+    fprintf(stderr, " [--evdev <event device or recording>] [--monitor <nr>] [--matrix [--apply]] [--preview] [--verify] [--one-shot] [--touch-select] [--wall <cols>x<rows> [--apply]] [--displays <display>,<display>,...] [--soak <nr of sessions>]\n");
     fprintf(stderr, "\t-h, --help: print this help message\n");
-    fprintf(stderr, "\t-v, --verbose: print debug messages during the process\n");
+    fprintf(stderr, "\t-v, --verbose: print debug messages (the trace, see --trace) during the process\n");
     fprintf(stderr, "\t--list: list calibratable input devices and quit\n");
     fprintf(stderr, "\t--device <device name or id>: select a specific device to calibrate\n");
     fprintf(stderr, "\t--precalib: manually provide the current calibration setting (eg. the values in xorg.conf)\n");
-    fprintf(stderr, "\t--misclick: set the misclick threshold (0=off, default: %i pixels)\n",
+    fprintf(stderr, "\t--misclick: set the misclick threshold (0=off, default: %i pixels at 96 DPI,\n\t\tscaled to the display's resolution and widened to the noise of the clicks;\n\t\ta value given is in pixels of this display)\n",
         thr_misclick);
     fprintf(stderr, "\t--fake: emulate a fake device (for testing purposes)\n");
     fprintf(stderr, "\t--geometry: manually provide the geometry (width and height) for the calibration window\n");
+    fprintf(stderr, "\t--grid: number of points to press horizontally and vertically (2 to %i, default: 2x2)\n", MAX_GRID);
+    fprintf(stderr, "\t--adaptive: start with the corners of the grid (default: 5x5) and add points where the error is largest, until it is below <nr of pixels>\n");
+    fprintf(stderr, "\t--confidence: estimate how precise the calibration is (by bootstrap) and have the points pressed\n\t\tonce more while a bound is not within <nr of pixels> (95%% interval)\n");
+    fprintf(stderr, "\t--correction: also fit a non-linear correction and write its grid to <file>\n");
+    fprintf(stderr, "\t--record: record the clicks to <file>, to try other settings on them (see xinput_calibrator_sweep)\n");
+    fprintf(stderr, "\t--metrics-file: write the session's metrics (clicks, rejects, restarts, time per target, ...)\n\t\tto <file>, in the Prometheus text format\n");
+    fprintf(stderr, "\t--checkpoint: save the clicks to <file> after each one, and resume from it when started again\n\t\ton the same device and display size (e.g. after a key press or the timeout)\n");
+    fprintf(stderr, "\t--trace: dump the trace of the last %i events (devices, clicks, ...) to <file> on failure\n\t\tor when sent SIGUSR1\n", TRACE_RECORDS);
+    fprintf(stderr, "\t--monitor: calibrate on this monitor (default: 0), with --matrix\n");
+    fprintf(stderr, "\t--matrix: calculate a coordinate transformation matrix relative to the whole screen\n\t\t(for a device on one of several monitors, rotated or inverted) instead of min/max values\n");
+    fprintf(stderr, "\t--apply: apply the new matrix to the device right away\n");
+    fprintf(stderr, "\t--preview: when done, show where presses end up with the new calibration;\n\t\taccept it with Enter (or by waiting), redo it with R\n");
+    fprintf(stderr, "\t--verify: when done, press a denser grid of points once more and see the error across the screen\n\t\t(a heatmap, and the max and mean error and worst region on stdout)\n");
+    fprintf(stderr, "\t--one-shot: multitouch screens, touch the four points at once (each touch is taken for the point\n\t\tnearest to it, so the current calibration must not be swapped or inverted)\n");
+    fprintf(stderr, "\t--touch-select: with several calibratable devices, calibrate the one that presses the first point\n");
+    fprintf(stderr, "\t--wall: video wall, the screen is split into <cols>x<rows> tiles with a touch overlay each;\n\t\tpress the points of each tile with its overlay, and get a matrix for each (see --matrix)\n");
+    fprintf(stderr, "\t--displays: multi-seat, calibrate a device on each of these displays at the same time\n");
+    fprintf(stderr, "\t--soak: developer mode, run <nr of sessions> calibrations with injected clicks (e.g. with --fake\n\t\tunder xvfb-run) and fail if memory, file descriptors, windows or main loop sources keep growing\n");
+    fprintf(stderr, "\t--evdev: read the clicks directly from an event device (/dev/input/eventN), in device coordinates;\n\t\tor replay a recording of one, with its --geometry and device range as --precalib\n");
 }
 
-struct Calib* main_common(int argc, char** argv)
+/**
+ * parse the options and find the device to calibrate
+ *
+ * 'displays' is a comma separated list of displays, the calibrator is for
+ * the first one and remembers the others (NULL: as given with --displays,
+ * or else the default display)
+ */
+struct Calib* main_common(int argc, char** argv, const char* displays, int* exit_status)
 {
     bool verbose = false;
     bool list_devices = false;
@@ -176,8 +88,35 @@ struct Calib* main_common(int argc, char** argv)
     XYinfo pre_axys = {-1, -1, -1, -1};
     const char* pre_device = NULL;
     const char* geometry = NULL;
+    const char* correction_file = NULL;
+    const char* record_file = NULL;
+    const char* metrics_file = NULL;
+    const char* checkpoint_file = NULL;
+    const char* trace_file = NULL;
+    const char* evdev = NULL;
+    bool evdev_live = false;
+    int old_swap_xy = 0;
+    int old_invert_x = 0;
+    int old_invert_y = 0;
+    int nr_candidates = 0;
+    int monitor = 0;
+    bool use_matrix = false;
+    bool apply_matrix = false;
+    const char* displays_opt = NULL;
+    int grid_cols = 0;
+    int grid_rows = 0;
+    int wall_cols = 0;
+    int wall_rows = 0;
+    float max_error = 0;
+    float max_interval = 0;
+    bool preview = false;
+    bool verify = false;
+    bool one_shot = false;
+    bool touch_select = false;
+    int soak = 0;
     unsigned thr_misclick = 15;
     unsigned thr_doubleclick = 7;
+    bool scale_misclick = true;
 
     /* parse input */
     if (argc > 1) {
@@ -188,7 +127,8 @@ struct Calib* main_common(int argc, char** argv)
                 strcmp("--help", argv[i]) == 0) {
                 fprintf(stderr, "xinput_calibratior, v%s\n\n", "0.0.0");
                 usage(argv[0], thr_misclick);
-                exit(0);
+                *exit_status = 0;
+                return NULL;
             } else
 
             /* Verbose output ? */
@@ -209,7 +149,8 @@ struct Calib* main_common(int argc, char** argv)
                 else {
                     fprintf(stderr, "Error: --device needs a device name or id as argument; use --list to list the calibratable input devices.\n\n");
                     usage(argv[0], thr_misclick);
-                    exit(1);
+                    *exit_status = 1;
+                    return NULL;
                 }
             } else
 
@@ -228,12 +169,14 @@ struct Calib* main_common(int argc, char** argv)
 
             /* Get mis-click threshold ? */
             if (strcmp("--misclick", argv[i]) == 0) {
-                if (argc > i+1)
+                if (argc > i+1) {
                     thr_misclick = atoi(argv[++i]);
-                else {
+                    scale_misclick = false;
+                } else {
                     fprintf(stderr, "Error: --misclick needs a number (the pixel threshold) as argument. Set to 0 to disable mis-click detection.\n\n");
                     usage(argv[0], thr_misclick);
-                    exit(1);
+                    *exit_status = 1;
+                    return NULL;
                 }
             } else
 
@@ -243,6 +186,192 @@ struct Calib* main_common(int argc, char** argv)
                 /* sscanf(argv[++i],"%dx%d",&win_width,&win_height); */
             } else
 
+            /* specify grid of points? */
+            if (strcmp("--grid", argv[i]) == 0) {
+                if (argc <= i+1 ||
+                    sscanf(argv[++i], "%dx%d", &grid_cols, &grid_rows) != 2 ||
+                    grid_cols < 2 || grid_cols > MAX_GRID ||
+                    grid_rows < 2 || grid_rows > MAX_GRID) {
+                    fprintf(stderr, "Error: --grid needs the number of points as <cols>x<rows>, each between 2 and %i.\n\n", MAX_GRID);
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* video wall of tiles? */
+            if (strcmp("--wall", argv[i]) == 0) {
+                if (argc <= i+1 ||
+                    sscanf(argv[++i], "%dx%d", &wall_cols, &wall_rows) != 2 ||
+                    wall_cols < 1 || wall_rows < 1 || wall_cols * wall_rows < 2 ||
+                    wall_cols * wall_rows > MAX_TILES) {
+                    fprintf(stderr, "Error: --wall needs the number of tiles as <cols>x<rows>, from 2 up to %i tiles.\n\n", MAX_TILES);
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* adaptive placement of the points? */
+            if (strcmp("--adaptive", argv[i]) == 0) {
+                if (argc > i+1 && (max_error = atof(argv[++i])) > 0) {
+                    /* OK */
+                } else {
+                    fprintf(stderr, "Error: --adaptive needs the error to reach (in pixels) as argument.\n\n");
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* estimate the precision of the calibration? */
+            if (strcmp("--confidence", argv[i]) == 0) {
+                if (argc > i+1 && (max_interval = atof(argv[++i])) > 0) {
+                    /* OK */
+                } else {
+                    fprintf(stderr, "Error: --confidence needs the widest interval to accept (in pixels) as argument.\n\n");
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* write a non-linear correction grid? */
+            if (strcmp("--correction", argv[i]) == 0) {
+                if (argc > i+1)
+                    correction_file = argv[++i];
+                else {
+                    fprintf(stderr, "Error: --correction needs a file name as argument.\n\n");
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* record the clicks ? */
+            if (strcmp("--record", argv[i]) == 0) {
+                if (argc > i+1)
+                    record_file = argv[++i];
+                else {
+                    fprintf(stderr, "Error: --record needs a file name as argument.\n\n");
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* write the session's metrics ? */
+            if (strcmp("--metrics-file", argv[i]) == 0) {
+                if (argc > i+1)
+                    metrics_file = argv[++i];
+                else {
+                    fprintf(stderr, "Error: --metrics-file needs a file name as argument.\n\n");
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* resume an interrupted calibration ? */
+            if (strcmp("--checkpoint", argv[i]) == 0) {
+                if (argc > i+1)
+                    checkpoint_file = argv[++i];
+                else {
+                    fprintf(stderr, "Error: --checkpoint needs a file name as argument.\n\n");
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* dump the trace ? */
+            if (strcmp("--trace", argv[i]) == 0) {
+                if (argc > i+1)
+                    trace_file = argv[++i];
+                else {
+                    fprintf(stderr, "Error: --trace needs a file name as argument.\n\n");
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* read clicks from an event device ? */
+            if (strcmp("--evdev", argv[i]) == 0) {
+                if (argc > i+1)
+                    evdev = argv[++i];
+                else {
+                    fprintf(stderr, "Error: --evdev needs an event device or recording as argument.\n\n");
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* calibrate on another monitor ? */
+            if (strcmp("--monitor", argv[i]) == 0) {
+                if (argc > i+1)
+                    monitor = atoi(argv[++i]);
+                else {
+                    fprintf(stderr, "Error: --monitor needs the number of the monitor as argument.\n\n");
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* multi-seat ? */
+            if (strcmp("--displays", argv[i]) == 0) {
+                if (argc > i+1)
+                    displays_opt = argv[++i];
+                else {
+                    fprintf(stderr, "Error: --displays needs a comma separated list of displays as argument.\n\n");
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* coordinate transformation matrix ? */
+            if (strcmp("--matrix", argv[i]) == 0) {
+                use_matrix = true;
+            } else
+            if (strcmp("--apply", argv[i]) == 0) {
+                apply_matrix = true;
+            } else
+
+            /* choose the device by touching the screen ? */
+            if (strcmp("--touch-select", argv[i]) == 0) {
+                touch_select = true;
+            } else
+
+            /* preview the result before accepting it ? */
+            if (strcmp("--preview", argv[i]) == 0) {
+                preview = true;
+            } else
+
+            /* look for leaks over many sessions ? */
+            if (strcmp("--soak", argv[i]) == 0) {
+                if (argc > i+1 && (soak = atoi(argv[++i])) > 0) {
+                    /* OK */
+                } else {
+                    fprintf(stderr, "Error: --soak needs the number of sessions to run as argument.\n\n");
+                    usage(argv[0], thr_misclick);
+                    *exit_status = 1;
+                    return NULL;
+                }
+            } else
+
+            /* all points at once ? */
+            if (strcmp("--one-shot", argv[i]) == 0) {
+                one_shot = true;
+            } else
+
+            /* check the result on a denser grid ? */
+            if (strcmp("--verify", argv[i]) == 0) {
+                verify = true;
+            } else
+
             /* Fake calibratable device ? */
             if (strcmp("--fake", argv[i]) == 0) {
                 fake = true;
@@ -252,15 +381,149 @@ struct Calib* main_common(int argc, char** argv)
             else {
                 fprintf(stderr, "Unknown option: %s\n\n", argv[i]);
                 usage(argv[0], thr_misclick);
-                exit(0);
+                *exit_status = 0;
+                return NULL;
             }
         }
     }
     
+    trace_init(trace_file, verbose);
+#ifndef NO_TRACE
+    calib_set_trace(trace_point);
+#endif
+
+    if (use_matrix && evdev != NULL) {
+        fprintf(stderr, "Error: --matrix needs the clicks in screen coordinates, it can not be used with --evdev\n");
+        *exit_status = 1;
+        return NULL;
+    }
+
+    if (touch_select && (use_matrix || evdev != NULL)) {
+        fprintf(stderr, "Error: --touch-select can not be used with --matrix or --evdev\n");
+        *exit_status = 1;
+        return NULL;
+    }
+
+    /* the checkpoint is for the device known at the start */
+    if (touch_select && checkpoint_file != NULL) {
+        fprintf(stderr, "Error: --checkpoint can not be used with --touch-select\n");
+        *exit_status = 1;
+        return NULL;
+    }
+#ifndef HAVE_XI22
+    if (touch_select) {
+        fprintf(stderr, "Error: --touch-select is not supported on this system (it needs XI 2.2)\n");
+        *exit_status = 1;
+        return NULL;
+    }
+    if (one_shot) {
+        fprintf(stderr, "Error: --one-shot is not supported on this system (it needs XI 2.2)\n");
+        *exit_status = 1;
+        return NULL;
+    }
+#endif
+
+    /* a session of its own: a calibrator (and matrix) for each tile */
+    if (wall_cols > 0 && (displays_opt != NULL || evdev != NULL || touch_select || one_shot ||
+                          preview || verify || max_error > 0 || max_interval > 0 ||
+                          correction_file != NULL || record_file != NULL ||
+                          metrics_file != NULL || checkpoint_file != NULL || soak > 0)) {
+        fprintf(stderr, "Error: --wall can not be used with --displays, --evdev, --touch-select, --one-shot, --preview, --verify,\n\t--adaptive, --confidence, --correction, --record, --metrics-file, --checkpoint or --soak\n");
+        *exit_status = 1;
+        return NULL;
+    }
+#ifndef HAVE_XI22
+    if (wall_cols > 0) {
+        fprintf(stderr, "Error: --wall is not supported on this system (it needs XI 2.2)\n");
+        *exit_status = 1;
+        return NULL;
+    }
+#endif
+    if (wall_cols > 0)
+        use_matrix = true;
+
+    /* one window for each display, in one main loop */
+    if (displays_opt != NULL) {
+        const char* d;
+        int nr_displays = 1;
+        for (d = displays_opt; *d != '\0'; d++)
+            if (*d == ',')
+                nr_displays++;
+        if (nr_displays > MAX_SEATS) {
+            fprintf(stderr, "Error: --displays can calibrate at most %i displays at once\n", MAX_SEATS);
+            *exit_status = 1;
+            return NULL;
+        }
+    }
+
+    /* min/max values span the whole screen, the driver knows no monitors */
+    if (monitor != 0 && !use_matrix) {
+        fprintf(stderr, "Error: --monitor needs --matrix, min/max values can only calibrate for the whole screen\n");
+        *exit_status = 1;
+        return NULL;
+    }
+    if (apply_matrix && !use_matrix) {
+        fprintf(stderr, "Error: --apply applies the coordinate transformation matrix, it needs --matrix or --wall\n");
+        *exit_status = 1;
+        return NULL;
+    }
+
+    /* one gesture: the four points of the default grid, all at once */
+    if (one_shot && (grid_cols != 0 || max_error > 0 || max_interval > 0 ||
+                     checkpoint_file != NULL || touch_select || evdev != NULL)) {
+        fprintf(stderr, "Error: --one-shot can not be used with --grid, --adaptive, --confidence, --checkpoint, --touch-select or --evdev\n");
+        *exit_status = 1;
+        return NULL;
+    }
+
+    /* the injected clicks are in screen coordinates, and nobody answers */
+    if (soak > 0 && (evdev != NULL || displays_opt != NULL || preview || touch_select)) {
+        fprintf(stderr, "Error: --soak can not be used with --evdev, --displays, --preview or --touch-select\n");
+        *exit_status = 1;
+        return NULL;
+    }
+
+    if (use_matrix && preview) {
+        fprintf(stderr, "Error: --preview shows min/max calibrations only, it can not be used with --matrix\n");
+        *exit_status = 1;
+        return NULL;
+    }
+
+    if (verify && (use_matrix || preview)) {
+        fprintf(stderr, "Error: --verify checks min/max calibrations only, it can not be used with --matrix or --preview\n");
+        *exit_status = 1;
+        return NULL;
+    }
+
+    /* The display of this calibrator: the first one of the list */
+    bool first = (displays == NULL);
+    char* display_name = NULL;
+    const char* more_displays = NULL;
+    if (first)
+        displays = displays_opt;
+    if (displays != NULL) {
+        const char* comma = strchr(displays, ',');
+        size_t len = (comma != NULL) ? (size_t)(comma - displays) : strlen(displays);
+
+        display_name = (char*)malloc(len + 1);
+        memcpy(display_name, displays, len);
+        display_name[len] = '\0';
+        if (comma != NULL)
+            more_displays = comma + 1;
+
+        if (evdev != NULL) {
+            fprintf(stderr, "Error: --evdev can not be used with --displays\n");
+            free(display_name);
+            *exit_status = 1;
+            return NULL;
+        }
+        TRACE_TEXT(TRACE_DISPLAY, display_name, 0, 0, 0, 0);
+    }
 
     /* Choose the device to calibrate */
-    XID         device_id   = (XID) -1;
+    int         device_id   = -1;
     const char* device_name = NULL;
+    char*       found_name  = NULL;
     XYinfo      device_axys = {-1, -1, -1, -1};
     if (fake) {
         /* Fake a calibratable device */
@@ -270,18 +533,64 @@ struct Calib* main_common(int argc, char** argv)
         device_axys.y_min=0;
         device_axys.y_max=1000;
 
-        if (verbose) {
-            printf("DEBUG: Faking device: %s\n", device_name);
+        TRACE_TEXT(TRACE_FAKE_DEVICE, device_name, 0, 0, 0, 0);
+    } else if (evdev != NULL) {
+#ifdef HAVE_LINUX_INPUT_H
+        /* the device range, unless it is a recording (see --precalib) */
+        int fd = open_evdev(evdev, false);
+        if (fd < 0) {
+            fprintf (stderr, "Error: unable to open '%s'\n", evdev);
+            *exit_status = 1;
+            return NULL;
+        }
+        evdev_live = get_evdev_range(fd, &device_axys);
+        close(fd);
+        device_name = evdev;
+
+        if (!evdev_live && !precalib) {
+            fprintf (stderr, "Error: '%s' is not an event device; to replay a recording, give the device range with --precalib\n", evdev);
+            *exit_status = 1;
+            return NULL;
         }
+
+        TRACE_TEXT(TRACE_EVDEV, evdev, evdev_live, 0, 0, 0);
+#else
+        fprintf (stderr, "Error: --evdev is not supported on this system\n");
+        *exit_status = 1;
+        return NULL;
+#endif
     } else {
         /* Find the right device */
-        int nr_found = find_device(pre_device, verbose, list_devices, &device_id, &device_name, &device_axys);
+        int nr_found = calib_find_device(display_name, pre_device, verbose, list_devices,
+                &device_id, &found_name, &device_axys);
+        device_name = found_name;
+
+        if (nr_found == CALIB_ERROR_DISPLAY) {
+            if (display_name != NULL)
+                fprintf(stderr, "Unable to connect to X server %s\n", display_name);
+            else
+                fprintf(stderr, "Unable to connect to X server\n");
+            free(display_name);
+            *exit_status = 1;
+            return NULL;
+        } else if (nr_found == CALIB_ERROR_XINPUT) {
+            fprintf(stderr, "X Input extension not available.\n");
+            free(display_name);
+            *exit_status = 1;
+            return NULL;
+        }
 
         if (list_devices) {
             /* printed the list in find_device */
             if (nr_found == 0)
                 printf("No calibratable devices found.\n");
-            exit(0);
+            /* and list those of the other displays */
+            if (more_displays != NULL)
+                main_common(argc, argv, more_displays, exit_status);
+            free(found_name);
+            free(display_name);
+            *exit_status = 0;
+            return NULL;
         }
 
         if (nr_found == 0) {
@@ -289,15 +598,33 @@ struct Calib* main_common(int argc, char** argv)
                 fprintf (stderr, "Error: No calibratable devices found.\n");
             else
                 fprintf (stderr, "Error: Device \"%s\" not found; use --list to list the calibratable input devices.\n", pre_device);
-            exit(1);
-
+            free(display_name);
+            *exit_status = 1;
+            return NULL;
+
+        } else if (wall_cols > 0) {
+            if (nr_found < wall_cols * wall_rows) {
+                fprintf(stderr, "Error: %i tiles need as many touch overlays, found %i\n",
+                        wall_cols * wall_rows, nr_found);
+                free(found_name);
+                free(display_name);
+                *exit_status = 1;
+                return NULL;
+            }
+            printf ("Video wall of %ix%i tiles, each calibrated with the overlay that presses its points\n", wall_cols, wall_rows);
+            nr_candidates = nr_found;
+        } else if (nr_found > 1 && touch_select) {
+            printf ("Multiple calibratable devices found, calibrating the one that presses the first point\n");
+            nr_candidates = nr_found;
         } else if (nr_found > 1) {
             printf ("Warning: multiple calibratable devices found, calibrating last one (%s)\n\tuse --device to select another one.\n", device_name);
         }
 
-        if (verbose) {
-            printf("DEBUG: Selected device: %s\n", device_name);
-        }
+        TRACE_TEXT(TRACE_SELECTED, device_name, device_id, nr_found, 0, 0);
+
+        /* the inversion is part of device_axys already */
+        calib_get_driver_state(display_name, device_id,
+                &old_swap_xy, &old_invert_x, &old_invert_y);
     }
 
     /* override min/max XY from command line ? */
@@ -310,45 +637,147 @@ struct Calib* main_common(int argc, char** argv)
             device_axys.y_min = pre_axys.y_min;
         if (pre_axys.y_max != -1)
             device_axys.y_max = pre_axys.y_max;
+        old_invert_x = old_invert_y = 0;
 
-        if (verbose) {
-            printf("DEBUG: Setting precalibration: %i, %i, %i, %i\n",
-                device_axys.x_min, device_axys.x_max,
+        TRACE(TRACE_PRECALIB, device_axys.x_min, device_axys.x_max,
                 device_axys.y_min, device_axys.y_max);
-        }
     }
 
     /* lastly, presume a standard Xorg driver (evtouch, mutouch, ...) */
-    return CalibratorXorgPrint(device_name, &device_axys,
+    struct Calib* c = CalibratorXorgPrint(device_name, &device_axys,
             verbose, thr_misclick, thr_doubleclick, geometry);
+    c->device_id = device_id;
+    /* the calibrator keeps (a copy of) the name */
+    if (found_name == NULL) {
+        found_name = (char*)malloc(strlen(device_name) + 1);
+        strcpy(found_name, device_name);
+    }
+    c->device_name = found_name;
+    c->old_swap_xy = old_swap_xy;
+    c->old_invert_x = old_invert_x;
+    c->old_invert_y = old_invert_y;
+    c->display_name = display_name;
+    c->more_displays = more_displays;
+    /* adaptive placement chooses from a finer grid */
+    if (grid_cols == 0)
+        grid_cols = grid_rows = (max_error > 0) ? 5 : 2;
+    c->num_cols = grid_cols;
+    c->num_rows = grid_rows;
+    c->max_error = max_error;
+    c->max_interval = max_interval;
+    c->preview = preview;
+    c->verify = verify;
+    c->one_shot = one_shot;
+    c->wall_cols = wall_cols;
+    c->wall_rows = wall_rows;
+    c->soak = soak;
+    /* a mis-click threshold given in pixels is taken as given */
+    c->scale_misclick = scale_misclick;
+    c->scale_doubleclick = true;
+    c->correction_file = correction_file;
+    /* one recording, metrics file and checkpoint: of the first display */
+    if (first) {
+        c->record_file = record_file;
+        c->metrics_file = metrics_file;
+        c->checkpoint_file = checkpoint_file;
+    }
+    c->evdev = evdev;
+    c->evdev_live = evdev_live;
+    c->monitor = monitor;
+    c->use_matrix = use_matrix;
+    c->apply_matrix = apply_matrix;
+
+    /* the device is not known until it presses the first point */
+    if (nr_candidates > 1) {
+        int i;
+        c->num_candidates = calib_find_devices(display_name, MAX_CANDIDATES,
+                c->candidate_id, c->candidate_name, c->candidate_axys);
+        if (c->num_candidates < 0)
+            c->num_candidates = 0;
+        else if (c->num_candidates > MAX_CANDIDATES) {
+            printf("Warning: %i calibratable devices found, only the first %i can be selected by touch\n",
+                   c->num_candidates, MAX_CANDIDATES);
+            c->num_candidates = MAX_CANDIDATES;
+        }
+        for (i = 0; i < c->num_candidates; i++) {
+            if (precalib)
+                c->candidate_axys[i] = device_axys;
+            TRACE_TEXT(TRACE_CANDIDATE, c->candidate_name[i], c->candidate_id[i], 0, 0, 0);
+        }
+        c->device_id = -1;
+    }
+
+    /* the matrix the clicks will go through (of each tile: see wall.h) */
+    if (use_matrix && wall_cols == 0) {
+        static const float identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+        int i;
+        memcpy(c->old_matrix, identity, sizeof(identity));
+
+        if (!fake && !calib_get_matrix(display_name, device_id, c->old_matrix)) {
+            fprintf(stderr, "Error: device \"%s\" has no coordinate transformation matrix\n", device_name);
+            free_calib(c);
+            *exit_status = 1;
+            return NULL;
+        }
+
+        for (i = 0; i < 3; i++)
+            TRACE(TRACE_MATRIX_ROW, i, c->old_matrix[3*i],
+                    c->old_matrix[3*i + 1], c->old_matrix[3*i + 2]);
+    }
+
+    return c;
 }
 
 struct Calib* CalibratorXorgPrint(const char* const device_name0, const XYinfo *axys0, const bool verbose0, const int thr_misclick, const int thr_doubleclick, const char* geometry)
 {
     struct Calib* c = (struct Calib*)calloc(1, sizeof(struct Calib));
     c->old_axys = *axys0;
+    c->num_cols = 2;
+    c->num_rows = 2;
     c->threshold_misclick = thr_misclick;
     c->threshold_doubleclick = thr_doubleclick;
     c->geometry = geometry;
+    c->verbose = verbose0;
 
     printf("Calibrating standard Xorg driver \"%s\"\n", device_name0);
     printf("\tcurrent calibration values: min_x=%d, max_x=%d and min_y=%d, max_y=%d\n",
                 c->old_axys.x_min, c->old_axys.x_max, c->old_axys.y_min, c->old_axys.y_max);
-    printf("\tIf these values are estimated wrong, either supply it manually with the --precalib option, or run the 'get_precalib.sh' script to automatically get it (through HAL).\n");
+    printf("\tIf these values are estimated wrong, supply them manually with the --precalib option.\n");
 
     return c;
 }
 
+/* free a list of calibrators, with what they own */
+void free_calib(struct Calib* c)
+{
+    while (c != NULL) {
+        struct Calib* next = c->next;
+        int i;
+
+        for (i = 0; i < c->num_candidates; i++)
+            free(c->candidate_name[i]);
+        free(c->device_name);
+        free((char*)c->display_name);
+        free(c);
+        c = next;
+    }
+}
+
 bool finish_data(struct Calib* c, const XYinfo new_axys, int swap_xy)
 {
     bool success = true;
 
-    /* we suppose the previous 'swap_xy' value was 0 */
-    /* (unfortunately there is no way to verify this (yet)) */
-    int new_swap_xy = swap_xy;
+    /* the swap is relative to the one the driver does now */
+    int new_swap_xy = c->old_swap_xy ^ swap_xy;
 
-    printf("\n\n--> Making the calibration permanent <--\n");
-    success &= output_xorgconfd(c, new_axys, swap_xy, new_swap_xy);
+    if (c->display_name != NULL)
+        printf("\n\n--> Making the calibration of display %s permanent <--\n", c->display_name);
+    else
+        printf("\n\n--> Making the calibration permanent <--\n");
+    if (c->use_matrix)
+        success &= output_matrix(c);
+    else
+        success &= output_xorgconfd(c, new_axys, swap_xy, new_swap_xy);
 
     return success;
 }
@@ -366,8 +795,42 @@ bool output_xorgconfd(struct Calib* c, const XYinfo new_axys, int swap_xy, int n
     printf("	Option	\"MaxX\"	\"%d\"\n", new_axys.x_max);
     printf("	Option	\"MinY\"	\"%d\"\n", new_axys.y_min);
     printf("	Option	\"MaxY\"	\"%d\"\n", new_axys.y_max);
-    if (swap_xy != 0)
-        printf("	Option	\"SwapXY\"	\"%d\" # unless it was already set to 1\n", new_swap_xy);
+    if (swap_xy != 0 || c->old_swap_xy)
+        printf("	Option	\"SwapXY\"	\"%d\"\n", new_swap_xy);
+    /* the driver's inversion is in the min/max values now */
+    if (c->old_invert_x)
+        printf("	Option	\"InvertX\"	\"0\"\n");
+    if (c->old_invert_y)
+        printf("	Option	\"InvertY\"	\"0\"\n");
+    printf("EndSection\n");
+
+    return true;
+}
+
+bool output_matrix(struct Calib* c)
+{
+    const float* m = c->new_matrix;
+    const char* sysfs_name = "!!Name_Of_TouchScreen!!";
+
+    if (c->apply_matrix) {
+        if (!calib_set_matrix(c->display_name, c->device_id, m)) {
+            fprintf(stderr, "Error: unable to apply the coordinate transformation matrix\n");
+            return false;
+        }
+        printf("  applied the new matrix to the device\n");
+    }
+
+    printf("  to apply it for this session, run:\n");
+    printf("xinput set-prop %d \"Coordinate Transformation Matrix\" %f %f %f %f %f %f %f %f %f\n",
+        c->device_id, m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7], m[8]);
+
+    /* xorg.conf.d snippet */
+    printf("  to make it permanent, copy the snippet below into '/etc/X11/xorg.conf.d/99-calibration.conf'\n");
+    printf("Section \"InputClass\"\n");
+    printf("	Identifier	\"calibration\"\n");
+    printf("	MatchProduct	\"%s\"\n", sysfs_name);
+    printf("	Option	\"TransformationMatrix\"	\"%f %f %f %f %f %f %f %f %f\"\n",
+        m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7], m[8]);
     printf("EndSection\n");
 
     return true;
@@ -379,20 +842,111 @@ int main(int argc, char** argv)
     XYinfo axys;
     bool swap_xy;
 
-    struct Calib* calibrator = main_common(argc, argv);
+    int exit_status = 0;
+    struct Calib* calibrator = main_common(argc, argv, NULL, &exit_status);
+    if (calibrator == NULL) {
+        if (exit_status != 0)
+            trace_dump();
+        return exit_status;
+    }
+
+    /* multi-seat: a calibrator for each of the other displays too */
+    struct Calib* c;
+    for (c = calibrator; c->more_displays != NULL; c = c->next) {
+        c->next = main_common(argc, argv, c->more_displays, &exit_status);
+        if (c->next == NULL) {
+            if (exit_status != 0)
+                trace_dump();
+            free_calib(calibrator);
+            return exit_status;
+        }
+    }
+
+#ifdef HAVE_LINUX_INPUT_H
+    /* a recording of the event device: no GUI needed */
+    if (calibrator->evdev != NULL && !calibrator->evdev_live) {
+        success = replay_clicks(calibrator, &axys, &swap_xy);
+        if (success)
+            success = finish_data(calibrator, axys, swap_xy);
+    } else
+#endif
+    if (calibrator->next == NULL) {
+        /* GTK setup */
+        gtk_init(&argc, &argv);
+
+        /* developer mode: no calibration to apply */
+        if (calibrator->soak > 0) {
+            success = run_soak(calibrator, calibrator->soak);
+            if (!success)
+                trace_dump();
+            free_calib(calibrator);
+            return success ? 0 : 1;
+        }
 
-    /* GTK setup */
-    gtk_init(&argc, &argv);
+        if (calibrator->wall_cols > 0) {
+            /* a matrix for each tile */
+            struct Wall* wall = run_wall(calibrator);
+            int t;
+
+            success = (wall != NULL);
+            axys = calibrator->old_axys;
+            swap_xy = false;
+            for (t = 0; success && t < wall->num_tiles; t++) {
+                printf("\n--> Tile %d: device \"%s\" <--", t + 1,
+                       wall->tile[t]->device_name != NULL ? wall->tile[t]->device_name : calibrator->device_name);
+                success = finish_data(wall->tile[t], axys, swap_xy);
+            }
+            free_wall(wall);
+        } else {
+            success = run_gui(calibrator, &axys, &swap_xy);
+            if (success)
+                success = finish_data(calibrator, axys, swap_xy);
+        }
+    } else {
+        /* GTK setup, with the first seat as default display */
+        g_setenv("DISPLAY", calibrator->display_name, TRUE);
+        gtk_init(&argc, &argv);
+
+        /* all seats at the same time, in one main loop */
+        struct CalibArea* areas[MAX_SEATS];
+        int nr_seats = 0;
+        bool all_started = true;
+        int i;
+        for (c = calibrator; c != NULL && nr_seats < MAX_SEATS; c = c->next) {
+            areas[nr_seats] = create_gui(c);
+            if (areas[nr_seats] != NULL)
+                nr_seats++;
+            else {
+                fprintf(stderr, "Error: display %s could not be set up for calibration\n", c->display_name);
+                all_started = false;
+            }
+        }
+
+        if (nr_seats > 0) {
+            TRACE(TRACE_GTK_MAIN, 0, 0, 0, 0);
+            gtk_main();
+            TRACE(TRACE_GTK_MAIN_DONE, 0, 0, 0, 0);
+        }
 
-    success = run_gui(calibrator, &axys, &swap_xy);
-    if (success)
-        success = finish_data(calibrator, axys, swap_xy);
+        success = (nr_seats > 0 && all_started);
+        for (i = 0; i < nr_seats; i++) {
+            struct Calib* seat = areas[i]->calibrator;
+            bool seat_success = finish_gui(areas[i], &axys, &swap_xy);
+            if (seat_success)
+                seat_success = finish_data(seat, axys, swap_xy);
+            if (!seat_success)
+                fprintf(stderr, "Error: display %s not calibrated\n", seat->display_name);
+            success &= seat_success;
+        }
+    }
 
     if (!success) {
         /* TODO, in GUI ? */
         fprintf(stderr, "Error: unable to apply or save configuration values\n");
+        TRACE(TRACE_FAILED, 0, 0, 0, 0);
+        trace_dump();
     }
 
-    free(calibrator);
-    return success;
+    free_calib(calibrator);
+    return success ? 0 : 1;
 }
@@ -27,30 +27,22 @@
 #include "calibrator.h"
 
 
-/* strdup: non-ansi */
-char* my_strdup(const char* s);
-char* my_strdup(const char* s) {
-    size_t len = strlen(s) + 1;
-    void* p = malloc(len);
-
-    if (p == NULL)
-        return NULL;
-
-    return (char*) memcpy(p, s, len);
-}
-
-int find_device(const char*, bool, bool, XID*, const char**, XYinfo*);
-
 static void usage(char* cmd, unsigned thr_misclick);
 
-struct Calib* main_common(int argc, char** argv);
+/* max nr of displays to calibrate at once */
+#define MAX_SEATS 16
+
+struct Calib* main_common(int argc, char** argv, const char* displays, int* exit_status);
 
 struct Calib* CalibratorXorgPrint(const char* const device_name, const XYinfo *axys,
         const bool verbose, const int thr_misclick, const int thr_doubleclick,
         const char* geometry);
 
+void free_calib(struct Calib*);
+
 bool finish_data(struct Calib*, const XYinfo new_axys, int swap_xy);
 bool output_xorgconfd(struct Calib*, const XYinfo new_axys, int swap_xy, int new_swap_xy);
+bool output_matrix(struct Calib*);
 
 int main(int argc, char** argv);
 
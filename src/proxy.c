@@ -0,0 +1,630 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Calibration proxy for drivers without calibration support: reads the
+ * events of a touchscreen's event device, applies the calibration and
+ * re-emits them through a uinput device.
+ *
+ * It can also read a recorded event stream instead, and then reports how
+ * many events per second it can transform and the time added per event.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+#include "calibrator.h"
+#include "correction.h"
+#include "evdev.h"
+
+/* nr of events read (and transformed) at once */
+#define BATCH 64
+
+/* the most events of a frame held back for the correction (a multitouch
+ * frame of ten fingers takes some 70) */
+#define FRAME_MAX (4*BATCH)
+
+/* room for the events emitted for a batch: the frame held back from the
+ * one before, the batch, and the corrected coordinates added to frames */
+#define OUT_MAX (FRAME_MAX + 3*BATCH)
+
+/* where the frame's ABS_X or ABS_Y is, if not at an index of 'held' */
+#define FRAME_NONE -1   /* not in the frame */
+#define FRAME_SENT -2   /* sent as is, the frame outgrew 'held' */
+
+#define BITS_PER_LONG (8 * sizeof(long))
+#define NLONGS(x)     (((x) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define TEST_BIT(bit, array) ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
+struct Proxy
+{
+    int in_fd;
+    int out_fd;
+    bool live;
+
+    /* out = in * scale + offset, clamped to [lo, hi], per absolute axis */
+    float scale[ABS_CNT];
+    float offset[ABS_CNT];
+    float lo[ABS_CNT];
+    float hi[ABS_CNT];
+
+    bool swap_xy;
+
+    /* optional non-linear correction, and the position it works on */
+    struct Correction *cor;
+    int raw_x, raw_y;
+    int cor_x, cor_y;
+
+    /* with a correction, the frame so far: held back until its SYN_REPORT
+     * (over reads), to correct its ABS_X and ABS_Y in place */
+    struct input_event held[FRAME_MAX];
+    int num_held;
+    int frame_x, frame_y;
+
+    /* statistics */
+    double events;
+    double busy;
+    double frames;
+    double delay;
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static void
+on_signal (int sig)
+{
+    stop = 1;
+}
+
+static double
+now (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * calibrate axis 'code' with device range [dev_min, dev_max]:
+ * the calibrated range [cal_min, cal_max] is stretched over the device range,
+ * which is what a driver does with its MinX/MaxX options
+ */
+static void
+set_axis (struct Proxy *p,
+          int           code,
+          int           dev_min,
+          int           dev_max,
+          float         cal_min,
+          float         cal_max)
+{
+    p->lo[code] = dev_min;
+    p->hi[code] = dev_max;
+    if (cal_max == cal_min)
+        return;
+    p->scale[code] = (dev_max - dev_min) / (cal_max - cal_min);
+    p->offset[code] = dev_min - cal_min * p->scale[code];
+}
+
+/* the multitouch axes get the same calibration, relative to their range */
+static void
+set_mt_axis (struct Proxy *p,
+             int           code,
+             int           mt_min,
+             int           mt_max,
+             int           dev_min,
+             int           dev_max,
+             int           cal_min,
+             int           cal_max)
+{
+    float f = (mt_max - mt_min) / (float)(dev_max - dev_min);
+    set_axis(p, code, mt_min, mt_max,
+             mt_min + (cal_min - dev_min) * f, mt_min + (cal_max - dev_min) * f);
+}
+
+/*
+ * the linear calibration of a batch of values; kept free of branches and
+ * aliasing so that the compiler turns it into SIMD code
+ */
+static void
+transform_batch (const float *in,
+                 const float *scale,
+                 const float *offset,
+                 const float *lo,
+                 const float *hi,
+                 float       *out,
+                 int          n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        float v = in[i] * scale[i] + offset[i];
+        v = v < lo[i] ? lo[i] : v;
+        v = v > hi[i] ? hi[i] : v;
+        out[i] = v;
+    }
+}
+
+/* add an event to the output buffer */
+static void
+add_event (struct input_event *out,
+           int                *n_out,
+           const struct input_event *ev,
+           int                 code,
+           int                 value)
+{
+    out[*n_out] = *ev;
+    out[*n_out].type = EV_ABS;
+    out[*n_out].code = code;
+    out[*n_out].value = value;
+    (*n_out)++;
+}
+
+/* move the held events to the output */
+static void
+release_held (struct Proxy       *p,
+              struct input_event *out,
+              int                *n_out)
+{
+    memcpy(out + *n_out, p->held, p->num_held * sizeof(*out));
+    *n_out += p->num_held;
+    p->num_held = 0;
+}
+
+/*
+ * transform a batch of 'n' events into 'out' (room for OUT_MAX events),
+ * returns the nr of events to emit
+ */
+static int
+process_batch (struct Proxy             *p,
+               const struct input_event *ev,
+               int                       n,
+               struct input_event       *out)
+{
+    float in_v[OUT_MAX], scale[OUT_MAX], offset[OUT_MAX], lo[OUT_MAX], hi[OUT_MAX];
+    float out_v[OUT_MAX];
+    int idx[OUT_MAX];
+    int n_out = 0, n_abs = 0;
+    int i;
+
+    /* non-linear correction: works on whole frames, in raw coordinates */
+    for (i = 0; i < n; i++)
+    {
+        if (p->cor == NULL)
+        {
+            out[n_out++] = ev[i];
+            continue;
+        }
+
+        /* a frame too long to hold goes out as it is, and gets the
+         * corrected coordinates added at its end */
+        if (p->num_held == FRAME_MAX)
+        {
+            release_held(p, out, &n_out);
+            if (p->frame_x >= 0)
+                p->frame_x = FRAME_SENT;
+            if (p->frame_y >= 0)
+                p->frame_y = FRAME_SENT;
+        }
+        p->held[p->num_held++] = ev[i];
+
+        if (ev[i].type == EV_ABS && ev[i].code == ABS_X)
+        {
+            p->raw_x = ev[i].value;
+            p->frame_x = p->num_held - 1;
+        }
+        else if (ev[i].type == EV_ABS && ev[i].code == ABS_Y)
+        {
+            p->raw_y = ev[i].value;
+            p->frame_y = p->num_held - 1;
+        }
+        else if (ev[i].type == EV_SYN && ev[i].code == SYN_REPORT)
+        {
+            int cx, cy;
+            struct input_event syn = p->held[--p->num_held];
+
+            if (p->frame_x == FRAME_NONE && p->frame_y == FRAME_NONE)
+            {
+                release_held(p, out, &n_out);
+                out[n_out++] = syn;
+                continue;
+            }
+
+            apply_correction(p->cor, p->raw_x, p->raw_y, &cx, &cy);
+
+            /* a change in one axis can move the other one too */
+            if (p->frame_x >= 0)
+                p->held[p->frame_x].value = cx;
+            if (p->frame_y >= 0)
+                p->held[p->frame_y].value = cy;
+            release_held(p, out, &n_out);
+            if (p->frame_x == FRAME_SENT || (p->frame_x == FRAME_NONE && cx != p->cor_x))
+                add_event(out, &n_out, &syn, ABS_X, cx);
+            if (p->frame_y == FRAME_SENT || (p->frame_y == FRAME_NONE && cy != p->cor_y))
+                add_event(out, &n_out, &syn, ABS_Y, cy);
+
+            out[n_out++] = syn;
+            p->cor_x = cx;
+            p->cor_y = cy;
+            p->frame_x = p->frame_y = FRAME_NONE;
+        }
+    }
+
+    /* swap the axes and gather the absolute values */
+    for (i = 0; i < n_out; i++)
+    {
+        int code;
+
+        if (out[i].type != EV_ABS)
+            continue;
+
+        code = out[i].code;
+        if (p->swap_xy)
+        {
+            switch (code)
+            {
+            case ABS_X: code = ABS_Y; break;
+            case ABS_Y: code = ABS_X; break;
+            case ABS_MT_POSITION_X: code = ABS_MT_POSITION_Y; break;
+            case ABS_MT_POSITION_Y: code = ABS_MT_POSITION_X; break;
+            }
+            out[i].code = code;
+        }
+
+        idx[n_abs] = i;
+        in_v[n_abs] = out[i].value;
+        scale[n_abs] = p->scale[code];
+        offset[n_abs] = p->offset[code];
+        lo[n_abs] = p->lo[code];
+        hi[n_abs] = p->hi[code];
+        n_abs++;
+    }
+
+    transform_batch(in_v, scale, offset, lo, hi, out_v, n_abs);
+
+    /* and scatter them back */
+    for (i = 0; i < n_abs; i++)
+        out[idx[i]].value = (int)(out_v[i] + (out_v[i] < 0 ? -0.5f : 0.5f));
+
+    return n_out;
+}
+
+/* create a uinput device with the same capabilities as the input device */
+static int
+create_uinput (int in_fd)
+{
+    static const struct { int type, max, ioc; } types[] = {
+        { EV_KEY, KEY_MAX, UI_SET_KEYBIT },
+        { EV_REL, REL_MAX, UI_SET_RELBIT },
+        { EV_ABS, ABS_MAX, UI_SET_ABSBIT },
+        { EV_MSC, MSC_MAX, UI_SET_MSCBIT }
+    };
+    unsigned long evbits[NLONGS(EV_CNT)];
+    unsigned long bits[NLONGS(KEY_CNT)];
+    struct uinput_user_dev dev;
+    char name[UINPUT_MAX_NAME_SIZE - 16];
+    int fd;
+    int t, code;
+
+    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if (fd < 0)
+        return -1;
+
+    memset(&dev, 0, sizeof(dev));
+    memset(name, 0, sizeof(name));
+    ioctl(in_fd, EVIOCGNAME(sizeof(name) - 1), name);
+    ioctl(in_fd, EVIOCGID, &dev.id);
+    snprintf(dev.name, sizeof(dev.name), "%s (calibrated)", name);
+
+    memset(evbits, 0, sizeof(evbits));
+    ioctl(in_fd, EVIOCGBIT(0, sizeof(evbits)), evbits);
+    ioctl(fd, UI_SET_EVBIT, EV_SYN);
+
+    for (t = 0; t < (int)(sizeof(types) / sizeof(types[0])); t++)
+    {
+        if (!TEST_BIT(types[t].type, evbits))
+            continue;
+        ioctl(fd, UI_SET_EVBIT, types[t].type);
+
+        memset(bits, 0, sizeof(bits));
+        ioctl(in_fd, EVIOCGBIT(types[t].type, sizeof(bits)), bits);
+        for (code = 0; code <= types[t].max; code++)
+        {
+            if (!TEST_BIT(code, bits))
+                continue;
+            ioctl(fd, types[t].ioc, code);
+
+            if (types[t].type == EV_ABS)
+            {
+                struct input_absinfo abs;
+                if (ioctl(in_fd, EVIOCGABS(code), &abs) == 0)
+                {
+                    dev.absmin[code] = abs.minimum;
+                    dev.absmax[code] = abs.maximum;
+                    dev.absfuzz[code] = abs.fuzz;
+                    dev.absflat[code] = abs.flat;
+                }
+            }
+        }
+    }
+
+    /* keep it a direct input device (touchscreen, not touchpad) */
+    memset(bits, 0, sizeof(bits));
+    if (ioctl(in_fd, EVIOCGPROP(sizeof(bits)), bits) >= 0)
+        for (code = 0; code < INPUT_PROP_CNT; code++)
+            if (TEST_BIT(code, bits))
+                ioctl(fd, UI_SET_PROPBIT, code);
+
+    if (write(fd, &dev, sizeof(dev)) != sizeof(dev) ||
+        ioctl(fd, UI_DEV_CREATE) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* read, transform and write events until the end of the stream */
+static bool
+run_proxy (struct Proxy *p)
+{
+    struct input_event ev[BATCH];
+    struct input_event out[OUT_MAX];
+    int n, n_out, i;
+
+    while (!stop)
+    {
+        double start;
+
+        n = read_events(p->in_fd, ev, BATCH);
+        /* a signal: see whether it was to stop */
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return (n == 0);
+
+        start = now();
+        n_out = process_batch(p, ev, n, out);
+        if (write(p->out_fd, out, n_out * sizeof(*out)) != (ssize_t)(n_out * sizeof(*out)))
+            return false;
+        p->busy += now() - start;
+        p->events += n;
+
+        /* delay since the kernel timestamped the event (live only) */
+        if (p->live)
+        {
+            double t = now();
+            for (i = 0; i < n; i++)
+                if (ev[i].type == EV_SYN && ev[i].code == SYN_REPORT)
+                {
+                    p->delay += t - (ev[i].input_event_sec + ev[i].input_event_usec / 1e6);
+                    p->frames++;
+                }
+        }
+    }
+
+    return true;
+}
+
+static void
+usage (char *cmd)
+{
+    fprintf(stderr, "Usage: %s [-h|--help] [-v|--verbose] [--calib <minx> <maxx> <miny> <maxy>] [--swap] [--correction <file>] [--range <minx> <maxx> <miny> <maxy>] [--output <file>] <event device or recording>\n", cmd);
+    fprintf(stderr, "\t-h, --help: print this help message\n");
+    fprintf(stderr, "\t-v, --verbose: print statistics when done\n");
+    fprintf(stderr, "\t--calib: the calibration values (as printed by xinput_calibrator)\n");
+    fprintf(stderr, "\t--swap: swap the x and y axis\n");
+    fprintf(stderr, "\t--correction: apply the correction grid written by xinput_calibrator --correction;\n\t\tit already maps to the calibration that was in place when it was written,\n\t\tso keep that one and do not use --calib or --swap with it\n");
+    fprintf(stderr, "\t--range: the range of the axes, needed for a recording\n");
+    fprintf(stderr, "\t--output: write the events to a file instead of a new uinput device\n");
+}
+
+static bool
+get_axys (int     argc,
+          char  **argv,
+          int    *i,
+          XYinfo *axys)
+{
+    if (argc <= *i + 4)
+        return false;
+    axys->x_min = atoi(argv[++*i]);
+    axys->x_max = atoi(argv[++*i]);
+    axys->y_min = atoi(argv[++*i]);
+    axys->y_max = atoi(argv[++*i]);
+    return true;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    struct Proxy p;
+    XYinfo range = {-1, -1, -1, -1};
+    XYinfo calib = {-1, -1, -1, -1};
+    bool verbose = false;
+    bool has_calib = false;
+    const char *input = NULL;
+    const char *output = NULL;
+    const char *correction_file = NULL;
+    struct input_absinfo mt_x, mt_y;
+    bool success;
+    int i;
+
+    memset(&p, 0, sizeof(p));
+    p.frame_x = p.frame_y = FRAME_NONE;
+    for (i = 0; i < ABS_CNT; i++)
+    {
+        p.scale[i] = 1;
+        p.lo[i] = -1e9f;
+        p.hi[i] = 1e9f;
+    }
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp("-h", argv[i]) == 0 || strcmp("--help", argv[i]) == 0) {
+            usage(argv[0]);
+            return 0;
+        } else if (strcmp("-v", argv[i]) == 0 || strcmp("--verbose", argv[i]) == 0) {
+            verbose = true;
+        } else if (strcmp("--calib", argv[i]) == 0) {
+            if (!get_axys(argc, argv, &i, &calib)) {
+                fprintf(stderr, "Error: --calib needs 4 values: <minx> <maxx> <miny> <maxy>\n\n");
+                usage(argv[0]);
+                return 1;
+            }
+            has_calib = true;
+        } else if (strcmp("--swap", argv[i]) == 0) {
+            p.swap_xy = true;
+        } else if (strcmp("--correction", argv[i]) == 0) {
+            if (argc <= i+1) {
+                fprintf(stderr, "Error: --correction needs a file name as argument.\n\n");
+                usage(argv[0]);
+                return 1;
+            }
+            correction_file = argv[++i];
+        } else if (strcmp("--range", argv[i]) == 0) {
+            if (!get_axys(argc, argv, &i, &range)) {
+                fprintf(stderr, "Error: --range needs 4 values: <minx> <maxx> <miny> <maxy>\n\n");
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp("--output", argv[i]) == 0) {
+            if (argc <= i+1) {
+                fprintf(stderr, "Error: --output needs a file name as argument.\n\n");
+                usage(argv[0]);
+                return 1;
+            }
+            output = argv[++i];
+        } else if (argv[i][0] != '-' && input == NULL) {
+            input = argv[i];
+        } else {
+            fprintf(stderr, "Unknown option: %s\n\n", argv[i]);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (input == NULL) {
+        usage(argv[0]);
+        return 1;
+    }
+    /* the correction is fitted to the calibration of the time, applying
+     * another one on top would correct twice */
+    if (correction_file != NULL && (has_calib || p.swap_xy)) {
+        fprintf(stderr, "Error: --correction can not be used with --calib or --swap\n");
+        return 1;
+    }
+
+    /* a device is grabbed, so the X server only sees the calibrated events */
+    p.in_fd = open_evdev(input, output == NULL);
+    if (p.in_fd < 0) {
+        fprintf(stderr, "Error: unable to open '%s': %s\n", input, strerror(errno));
+        return 1;
+    }
+    p.live = get_evdev_range(p.in_fd, &range);
+    if (range.x_min == range.x_max || range.y_min == range.y_max) {
+        fprintf(stderr, "Error: '%s' is not an event device, use --range to give the range of a recording\n", input);
+        return 1;
+    }
+    if (correction_file != NULL) {
+        p.cor = load_correction(correction_file);
+        if (p.cor == NULL) {
+            fprintf(stderr, "Error: '%s' is not a valid correction grid\n", correction_file);
+            return 1;
+        }
+    }
+
+    if (has_calib) {
+        set_axis(&p, ABS_X, range.x_min, range.x_max, calib.x_min, calib.x_max);
+        set_axis(&p, ABS_Y, range.y_min, range.y_max, calib.y_min, calib.y_max);
+
+        if (!p.live || ioctl(p.in_fd, EVIOCGABS(ABS_MT_POSITION_X), &mt_x) < 0 ||
+                       ioctl(p.in_fd, EVIOCGABS(ABS_MT_POSITION_Y), &mt_y) < 0) {
+            mt_x.minimum = range.x_min;
+            mt_x.maximum = range.x_max;
+            mt_y.minimum = range.y_min;
+            mt_y.maximum = range.y_max;
+        }
+        if (mt_x.maximum != mt_x.minimum && mt_y.maximum != mt_y.minimum) {
+            set_mt_axis(&p, ABS_MT_POSITION_X, mt_x.minimum, mt_x.maximum,
+                        range.x_min, range.x_max, calib.x_min, calib.x_max);
+            set_mt_axis(&p, ABS_MT_POSITION_Y, mt_y.minimum, mt_y.maximum,
+                        range.y_min, range.y_max, calib.y_min, calib.y_max);
+        }
+    }
+
+    if (output != NULL)
+        p.out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    else if (p.live)
+        p.out_fd = create_uinput(p.in_fd);
+    else
+        p.out_fd = open("/dev/null", O_WRONLY);
+    if (p.out_fd < 0) {
+        fprintf(stderr, "Error: unable to open the output (%s)\n",
+                output != NULL ? output : "/dev/uinput");
+        return 1;
+    }
+
+    if (p.live) {
+        int clk = CLOCK_MONOTONIC;
+        struct sigaction sa;
+
+        ioctl(p.in_fd, EVIOCSCLOCKID, &clk);
+
+        /* no SA_RESTART: the read is interrupted to see 'stop', and the
+         * handler stays for a second signal */
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_signal;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+    }
+
+    success = run_proxy(&p);
+
+    if ((verbose || !p.live) && p.events > 0) {
+        printf("%.0f events, %.0f events per second, %.3f us added per event\n",
+               p.events, p.events / p.busy, p.busy / p.events * 1e6);
+        if (p.frames > 0)
+            printf("%.3f ms from the kernel to the output per frame\n",
+                   p.delay / p.frames * 1e3);
+    }
+
+    if (p.live && output == NULL)
+        ioctl(p.out_fd, UI_DEV_DESTROY);
+    close(p.out_fd);
+    close(p.in_fd);
+    free_correction(p.cor);
+
+    return success ? 0 : 1;
+}
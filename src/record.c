@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "record.h"
+
+/* start of a session: the geometry and settings the clicks depend on */
+void
+record_session (FILE         *f,
+                struct Calib *c,
+                int           width,
+                int           height)
+{
+    fprintf(f, "session %d %d %d %d\n", width, height, c->num_cols, c->num_rows);
+    fprintf(f, "old_axys %d %d %d %d\n",
+            c->old_axys.x_min, c->old_axys.x_max, c->old_axys.y_min, c->old_axys.y_max);
+    fflush(f);
+}
+
+void
+record_click (FILE *f,
+              int   target,
+              int   x,
+              int   y)
+{
+    fprintf(f, "click %d %d %d\n", target, x, y);
+    fflush(f);
+}
+
+/*
+ * read a recording, NULL if there is none. When the display was resized
+ * during the session, it was restarted: only the last session counts.
+ */
+struct Recording*
+read_recording (const char *filename)
+{
+    struct Recording *r;
+    char line[256];
+    int size = 0;
+    bool session = false;
+    FILE *f;
+
+    f = fopen(filename, "r");
+    if (f == NULL)
+        return NULL;
+
+    r = (struct Recording*)calloc(1, sizeof(struct Recording));
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        int t, x, y;
+
+        if (strncmp(line, "session ", 8) == 0)
+        {
+            r->num_clicks = 0;
+            session = (sscanf(line + 8, "%d %d %d %d", &r->width, &r->height,
+                              &r->num_cols, &r->num_rows) == 4);
+        }
+        else if (strncmp(line, "old_axys ", 9) == 0)
+        {
+            sscanf(line + 9, "%d %d %d %d", &r->old_axys.x_min, &r->old_axys.x_max,
+                   &r->old_axys.y_min, &r->old_axys.y_max);
+        }
+        else if (session && sscanf(line, "click %d %d %d", &t, &x, &y) == 3)
+        {
+            if (r->num_clicks == size)
+            {
+                size = size ? 2*size : 16;
+                r->target = (int*)realloc(r->target, size * sizeof(int));
+                r->x = (int*)realloc(r->x, size * sizeof(int));
+                r->y = (int*)realloc(r->y, size * sizeof(int));
+            }
+            r->target[r->num_clicks] = t;
+            r->x[r->num_clicks] = x;
+            r->y[r->num_clicks] = y;
+            r->num_clicks++;
+        }
+    }
+    fclose(f);
+
+    if (!session || r->num_cols < 2 || r->num_cols > MAX_GRID ||
+        r->num_rows < 2 || r->num_rows > MAX_GRID ||
+        r->width <= 0 || r->height <= 0)
+    {
+        free_recording(r);
+        return NULL;
+    }
+
+    return r;
+}
+
+void
+free_recording (struct Recording *r)
+{
+    if (r == NULL)
+        return;
+    free(r->target);
+    free(r->x);
+    free(r->y);
+    free(r);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _record_h
+#define _record_h
+
+#include <stdio.h>
+
+#include "calibrator.h"
+
+/*
+ * Recording of a calibration session (--record), to replay it later with
+ * other settings (see xinput_calibrator_sweep). It is a text file:
+ *
+ *   session <width> <height> <cols> <rows>
+ *   old_axys <x_min> <x_max> <y_min> <y_max>
+ *   click <target> <x> <y>
+ *   ...
+ *
+ * with every click as it was given to add_click(), and the point of the
+ * grid that was shown at the time (see grid_point()). A resize restarts the calibration,
+ * and the recording with a new 'session' line.
+ */
+
+struct Recording
+{
+    int width;
+    int height;
+    int num_cols;
+    int num_rows;
+    XYinfo old_axys;
+
+    int num_clicks;
+    int *target;
+    int *x;
+    int *y;
+};
+
+void              record_session (FILE         *f,
+                                  struct Calib *c,
+                                  int           width,
+                                  int           height);
+void              record_click   (FILE         *f,
+                                  int           target,
+                                  int           x,
+                                  int           y);
+struct Recording* read_recording (const char   *filename);
+void              free_recording (struct Recording *r);
+
+#endif /* _record_h */
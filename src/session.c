@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include "calibrator.h"
+
+/* defaults, as for xinput_calibrator */
+#define DEFAULT_TIMEOUT     15000
+#define DEFAULT_MISCLICK    15
+#define DEFAULT_DOUBLECLICK 7
+
+struct CalibSession
+{
+    struct Calib calib;
+    int width;
+    int height;
+
+    /* timeout in ms (0 for none) and time since the last click */
+    int timeout;
+    int time_elapsed;
+
+    enum CalibState state;
+    const char *message;
+
+    XYinfo result;
+    bool swap_xy;
+};
+
+struct CalibSession*
+calib_session_new (const XYinfo *old_axys,
+                   int           width,
+                   int           height)
+{
+    struct CalibSession *s;
+
+    if (width <= 0 || height <= 0)
+        return NULL;
+
+    s = (struct CalibSession*)calloc(1, sizeof(struct CalibSession));
+    if (s == NULL)
+        return NULL;
+
+    s->calib.old_axys = *old_axys;
+    s->calib.device_id = -1;
+    s->calib.num_cols = 2;
+    s->calib.num_rows = 2;
+    s->calib.threshold_misclick = DEFAULT_MISCLICK;
+    s->calib.threshold_doubleclick = DEFAULT_DOUBLECLICK;
+    s->width = width;
+    s->height = height;
+    s->timeout = DEFAULT_TIMEOUT;
+    s->state = CALIB_WAITING;
+    reset(&s->calib);
+
+    return s;
+}
+
+void
+calib_session_free (struct CalibSession *s)
+{
+    free(s);
+}
+
+int
+calib_session_set_grid (struct CalibSession *s,
+                        int                  cols,
+                        int                  rows)
+{
+    if (s->calib.num_clicks > 0 ||
+        cols < 2 || cols > MAX_GRID || rows < 2 || rows > MAX_GRID)
+        return 0;
+
+    s->calib.num_cols = cols;
+    s->calib.num_rows = rows;
+    reset(&s->calib);
+    return 1;
+}
+
+void
+calib_session_set_thresholds (struct CalibSession *s,
+                              int                  misclick,
+                              int                  doubleclick)
+{
+    s->calib.threshold_misclick = misclick;
+    s->calib.threshold_doubleclick = doubleclick;
+}
+
+void
+calib_session_set_resolution (struct CalibSession *s,
+                              double               px_per_mm)
+{
+    s->calib.px_per_mm = px_per_mm;
+    s->calib.scale_misclick = true;
+    s->calib.scale_doubleclick = true;
+}
+
+void
+calib_session_set_timeout (struct CalibSession *s,
+                           int                  ms)
+{
+    s->timeout = ms;
+}
+
+/* the target to click next, returns its index in the grid (-1 when not waiting) */
+int
+calib_session_get_target (struct CalibSession *s,
+                          double              *x,
+                          double              *y)
+{
+    if (s->state != CALIB_WAITING)
+        return -1;
+
+    get_target(&s->calib, grid_point(&s->calib, s->calib.num_clicks), s->width, s->height, x, y);
+    return grid_point(&s->calib, s->calib.num_clicks);
+}
+
+enum CalibState
+calib_session_click (struct CalibSession *s,
+                     int                  x,
+                     int                  y)
+{
+    int num_clicks = s->calib.num_clicks;
+    int num_dropped = s->calib.num_dropped;
+    bool success;
+
+    if (s->state != CALIB_WAITING)
+        return s->state;
+
+    s->time_elapsed = 0;
+    success = add_click(&s->calib, x, y);
+
+    if (!success && num_clicks > 0 && s->calib.num_clicks == 0)
+        s->message = "Mis-click detected, restarting...";
+    else if (!success && s->calib.num_rejected > 0)
+        s->message = "Mis-click detected, press the point again";
+    else if (s->calib.num_dropped != num_dropped)
+        s->message = "An earlier point was off, press it again";
+    else
+        s->message = NULL;
+
+    if (s->calib.num_clicks >= num_targets(&s->calib))
+    {
+        if (finish(&s->calib, s->width, s->height, &s->result, &s->swap_xy))
+            s->state = CALIB_DONE;
+        else
+            s->state = CALIB_FAILED;
+    }
+
+    return s->state;
+}
+
+/* let 'elapsed_ms' pass, for the timeout */
+enum CalibState
+calib_session_advance (struct CalibSession *s,
+                       int                  elapsed_ms)
+{
+    if (s->state != CALIB_WAITING || s->timeout <= 0)
+        return s->state;
+
+    s->time_elapsed += elapsed_ms;
+    if (s->time_elapsed >= s->timeout)
+        s->state = CALIB_TIMED_OUT;
+
+    return s->state;
+}
+
+/* ms until the timeout, -1 if there is none (e.g. as a poll() timeout) */
+int
+calib_session_timeout (struct CalibSession *s)
+{
+    if (s->state != CALIB_WAITING || s->timeout <= 0)
+        return -1;
+
+    return s->timeout - s->time_elapsed;
+}
+
+void
+calib_session_abort (struct CalibSession *s)
+{
+    if (s->state == CALIB_WAITING)
+        s->state = CALIB_ABORTED;
+}
+
+enum CalibState
+calib_session_state (struct CalibSession *s)
+{
+    return s->state;
+}
+
+const char*
+calib_session_message (struct CalibSession *s)
+{
+    return s->message;
+}
+
+/* the new calibration, returns 0 unless the session is done */
+int
+calib_session_result (struct CalibSession *s,
+                      XYinfo              *new_axys,
+                      int                 *swap_xy)
+{
+    if (s->state != CALIB_DONE)
+        return 0;
+
+    *new_axys = s->result;
+    *swap_xy = s->swap_xy;
+    return 1;
+}
@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+#ifdef HAVE_XRES
+#include <X11/extensions/XRes.h>
+#endif
+
+#include "gui_gtk.h"
+#include "soak.h"
+
+/* time between injected clicks (ms) */
+#define INJECT_INTERVAL 5
+
+/* every this many clicks is a mis-click */
+#define MISCLICK_EVERY 11
+
+/* clicks after which a session is given up */
+#define MAX_INJECTED (4 * MAX_POINTS)
+
+/* what the process holds */
+struct Usage
+{
+    long resident;      /* bytes */
+    int fds;
+    int windows;        /* top-level windows of the default display */
+    int resources;      /* X resources of ours, -1 without XRes */
+    int sources;        /* of the default main context */
+};
+
+/* clicks injected into a session */
+struct Injector
+{
+    struct CalibArea *calib_area;
+    unsigned long seed;
+    int clicks;
+    guint source;
+};
+
+static unsigned long
+next_random(unsigned long *seed)
+{
+    *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return *seed >> 16;
+}
+
+/* close the window as a key press would, and stop injecting */
+static gboolean
+close_session(struct Injector *inj)
+{
+    GtkWidget *parent = gtk_widget_get_parent(inj->calib_area->drawing_area);
+
+    if (parent)
+        gtk_widget_destroy(parent);
+    inj->source = 0;
+    return FALSE;
+}
+
+/* press the current target, a bit off, or somewhere else now and then */
+static gboolean
+inject_click(gpointer data)
+{
+    struct Injector *inj = (struct Injector*)data;
+    struct CalibArea *calib_area = inj->calib_area;
+    struct Calib *c = calib_area->calibrator;
+    double x, y;
+    int p;
+
+    /* the targets are known once the window has its size */
+    if (!gtk_widget_get_mapped(calib_area->drawing_area))
+        return TRUE;
+    resize_display(calib_area);
+
+    if (++inj->clicks > MAX_INJECTED)
+    {
+        fprintf(stderr, "Warning: soak session not done after %d clicks, closing it\n", MAX_INJECTED);
+        return close_session(inj);
+    }
+
+    /* verification (--verify): its points, and done once they are */
+    if (calib_area->verifying)
+    {
+        struct Verification *v = &calib_area->verify;
+
+        if (v->num_pressed == VERIFY_POINTS)
+            return close_session(inj);
+        x = v->target_x[v->num_pressed];
+        y = v->target_y[v->num_pressed];
+    }
+    else
+    {
+        p = grid_point(c, c->num_clicks);
+        x = calib_area->X[p];
+        y = calib_area->Y[p];
+    }
+    x += (int)(next_random(&inj->seed) % 5) - 2;
+    y += (int)(next_random(&inj->seed) % 5) - 2;
+    if (inj->clicks % MISCLICK_EVERY == 0)
+        x += calib_area->display_width / 8;
+
+    if (!handle_click(calib_area, calib_area->monitor.x + (int)x, calib_area->monitor.y + (int)y))
+    {
+        inj->source = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* one session, with the clicks injected; returns whether it calibrated */
+static bool
+soak_session(struct Calib   *c,
+             unsigned long   seed)
+{
+    struct Injector inj;
+    XYinfo new_axys;
+    bool swap;
+
+    inj.calib_area = create_gui(c);
+    if (inj.calib_area == NULL)
+        return false;
+    inj.seed = seed;
+    inj.clicks = 0;
+    inj.source = g_timeout_add(INJECT_INTERVAL, inject_click, &inj);
+
+    gtk_main();
+
+    /* e.g. closed by the timeout */
+    if (inj.source != 0)
+        g_source_remove(inj.source);
+
+    return finish_gui(inj.calib_area, &new_axys, &swap);
+}
+
+static long
+resident_bytes(void)
+{
+    long size, resident;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f == NULL)
+        return -1;
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+        resident = -1;
+    fclose(f);
+
+    return (resident < 0) ? -1 : resident * sysconf(_SC_PAGESIZE);
+}
+
+static int
+open_fds(void)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    struct dirent *entry;
+    int n = 0;
+
+    if (dir == NULL)
+        return -1;
+    while ((entry = readdir(dir)) != NULL)
+        if (entry->d_name[0] != '.')
+            n++;
+    closedir(dir);
+
+    /* not the one of opendir() */
+    return n - 1;
+}
+
+static int
+toplevel_windows(void)
+{
+    Display *display = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
+    Window root, parent, *children = NULL;
+    unsigned int n = 0;
+
+    if (!XQueryTree(display, DefaultRootWindow(display), &root, &parent, &children, &n))
+        return -1;
+    if (children != NULL)
+        XFree(children);
+    return (int)n;
+}
+
+/*
+ * All X resources the server holds for us (pixmaps, GCs, cursors, fonts,
+ * ...), of all types together. Any XID of ours tells it which client we
+ * are, a fresh one will do.
+ */
+static int
+client_resources(void)
+{
+#ifdef HAVE_XRES
+    Display *display = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
+    XResType *types = NULL;
+    int event_base, error_base;
+    int num_types = 0;
+    int n = 0;
+    int i;
+
+    if (!XResQueryExtension(display, &event_base, &error_base) ||
+        !XResQueryClientResources(display, XAllocID(display), &num_types, &types))
+        return -1;
+    for (i = 0; i < num_types; i++)
+        n += types[i].count;
+    if (types != NULL)
+        XFree(types);
+    return n;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * GLib has no list of the sources: probe the ids given out so far (a new
+ * source gets the next one)
+ */
+static int
+live_sources(void)
+{
+    guint last = g_idle_add((GSourceFunc)gtk_false, NULL);
+    guint id;
+    int n = 0;
+
+    g_source_remove(last);
+    for (id = 1; id < last; id++)
+        if (g_main_context_find_source_by_id(NULL, id) != NULL)
+            n++;
+    return n;
+}
+
+static void
+get_usage(struct Usage *usage)
+{
+    usage->resident = resident_bytes();
+    usage->fds = open_fds();
+    usage->windows = toplevel_windows();
+    usage->resources = client_resources();
+    usage->sources = live_sources();
+}
+
+static void
+print_usage(const char *what, int session, int num_failed, const struct Usage *usage)
+{
+    printf("Soak %s, %d sessions (%d failed): %ld kB resident, %d fds, %d windows, ",
+           what, session, num_failed, usage->resident / 1024,
+           usage->fds, usage->windows);
+    if (usage->resources >= 0)
+        printf("%d X resources, ", usage->resources);
+    printf("%d sources\n", usage->sources);
+}
+
+/* complain about one count that grew */
+static bool
+check_growth(const char *what, long before, long after, long slack)
+{
+    if (after <= before + slack)
+        return true;
+    fprintf(stderr, "Error: %s grew from %ld to %ld after the warm-up\n", what, before, after);
+    return false;
+}
+
+bool
+run_soak(struct Calib *c,
+         int           num_sessions)
+{
+    struct Usage base, usage;
+    int warmup = num_sessions / 10;
+    int report = num_sessions / 20;
+    int num_failed = 0;
+    bool ok = true;
+    int i;
+
+    if (warmup < SOAK_WARMUP)
+        warmup = SOAK_WARMUP;
+    if (report < 1)
+        report = 1;
+    if (num_sessions <= warmup)
+        fprintf(stderr, "Warning: %d sessions are all warm-up, nothing to compare\n", num_sessions);
+    if (client_resources() < 0)
+        printf("Soak without XRes: of the X resources only the top-level windows are checked\n");
+
+    for (i = 1; i <= num_sessions; i++)
+    {
+        if (!soak_session(c, (unsigned long)i))
+            num_failed++;
+
+        if (i == warmup)
+        {
+            get_usage(&base);
+            print_usage("warm-up", i, num_failed, &base);
+        }
+        else if (i % report == 0 || i == num_sessions)
+        {
+            get_usage(&usage);
+            print_usage("progress", i, num_failed, &usage);
+        }
+    }
+
+    if (num_sessions > warmup)
+    {
+        ok &= check_growth("resident memory", base.resident, usage.resident, SOAK_RSS_SLACK);
+        ok &= check_growth("file descriptors", base.fds, usage.fds, 0);
+        ok &= check_growth("top-level windows", base.windows, usage.windows, 0);
+        if (base.resources >= 0 && usage.resources >= 0)
+            ok &= check_growth("X resources", base.resources, usage.resources, 0);
+        ok &= check_growth("main loop sources", base.sources, usage.sources, 0);
+    }
+    printf("Soak %s: %d sessions, %d failed\n", ok ? "passed" : "failed",
+           num_sessions, num_failed);
+
+    return ok;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _soak_h
+#define _soak_h
+
+#include "calibrator.h"
+
+/*
+ * Developer mode (--soak): run calibration sessions one after the other,
+ * with the clicks injected, to find what a session leaves behind. After a
+ * warm-up (caches, the first windows of GTK) the resident memory, open file
+ * descriptors, top-level windows and main loop sources must stay put.
+ *
+ * Run it under a throw-away X server, e.g.
+ *   xvfb-run xinput_calibrator --fake --soak 1000
+ */
+
+/* sessions of the warm-up: a tenth of them, and at least this many */
+#define SOAK_WARMUP 10
+
+/* growth of the resident memory still taken as noise (bytes) */
+#define SOAK_RSS_SLACK (1024 * 1024)
+
+/* returns false if something grows after the warm-up */
+bool run_soak(struct Calib *c,
+              int           num_sessions);
+
+#endif /* _soak_h */
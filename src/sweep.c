@@ -0,0 +1,486 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Threshold tuning: replays recorded calibration sessions (--record)
+ * through the calibrator with a range of mis-click and double-click
+ * thresholds, and reports for each setting how many clicks were rejected,
+ * how many bad clicks got through and how good the calibration was.
+ *
+ * Whether a click was bad is decided per session from a reference: an
+ * affine map from the targets to the clicks, fitted by least squares and
+ * refitted without the clicks too far from it. The settings are spread
+ * over worker threads; replaying only needs a struct Calib of its own.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "calibrator.h"
+#include "record.h"
+
+/* nr of times the reference is refitted without the bad clicks */
+#define REFIT 3
+
+/* a recorded session, with its reference and which clicks are bad */
+struct Session
+{
+    struct Recording *rec;
+
+    /* click = ref[0] + ref[1]*target_x + ref[2]*target_y, per axis */
+    double ref_x[3];
+    double ref_y[3];
+
+    bool *bad;
+    int num_bad;
+};
+
+/* the outcome of one setting, over all sessions */
+struct Result
+{
+    int threshold_misclick;
+    int threshold_doubleclick;
+
+    int clicks;
+    int bad;
+    int rejected;
+    int good_rejected;
+    int bad_accepted;
+    int finished;
+    double error;
+};
+
+struct Sweep
+{
+    struct Session *sessions;
+    int num_sessions;
+
+    struct Result *results;
+    int num_results;
+
+    /* next result to compute */
+    int next;
+    pthread_mutex_t lock;
+};
+
+/* determinant of the 3x3 matrix with columns a, b, c */
+static double
+det3 (const double *a,
+      const double *b,
+      const double *c)
+{
+    return a[0] * (b[1]*c[2] - b[2]*c[1]) -
+           b[0] * (a[1]*c[2] - a[2]*c[1]) +
+           c[0] * (a[1]*b[2] - a[2]*b[1]);
+}
+
+/*
+ * least squares fit of the clicks to the targets, of the clicks that are
+ * not (yet) found to be bad; false if the fit is degenerate
+ */
+static bool
+fit_reference (struct Session *s,
+               const double   *target_x,
+               const double   *target_y)
+{
+    struct Recording *r = s->rec;
+    double n[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+    double bx[3] = {0, 0, 0};
+    double by[3] = {0, 0, 0};
+    double col[3];
+    double det;
+    int i, j;
+
+    for (i = 0; i < r->num_clicks; i++)
+    {
+        double v[3];
+
+        if (s->bad[i])
+            continue;
+        v[0] = 1;
+        v[1] = target_x[r->target[i]];
+        v[2] = target_y[r->target[i]];
+        for (j = 0; j < 9; j++)
+            n[j] += v[j / 3] * v[j % 3];
+        for (j = 0; j < 3; j++)
+        {
+            bx[j] += v[j] * r->x[i];
+            by[j] += v[j] * r->y[i];
+        }
+    }
+
+    /* normal equations, by Cramer's rule (n is symmetric) */
+    det = det3(n, n + 3, n + 6);
+    if (fabs(det) < 1e-9)
+        return false;
+    for (j = 0; j < 3; j++)
+    {
+        memcpy(col, n + 3*j, sizeof(col));
+        memcpy(n + 3*j, bx, sizeof(col));
+        s->ref_x[j] = det3(n, n + 3, n + 6) / det;
+        memcpy(n + 3*j, by, sizeof(col));
+        s->ref_y[j] = det3(n, n + 3, n + 6) / det;
+        memcpy(n + 3*j, col, sizeof(col));
+    }
+
+    return true;
+}
+
+/* where, according to the reference, a press on target (x, y) ends up */
+static void
+reference_click (struct Session *s,
+                 double          x,
+                 double          y,
+                 double         *click_x,
+                 double         *click_y)
+{
+    *click_x = s->ref_x[0] + s->ref_x[1] * x + s->ref_x[2] * y;
+    *click_y = s->ref_y[0] + s->ref_y[1] * x + s->ref_y[2] * y;
+}
+
+/* find the reference and the bad clicks of a session */
+static bool
+prepare_session (struct Session *s,
+                 double          tolerance)
+{
+    struct Recording *r = s->rec;
+    struct Calib c;
+    double target_x[MAX_POINTS], target_y[MAX_POINTS];
+    int i, k;
+
+    memset(&c, 0, sizeof(c));
+    c.num_cols = r->num_cols;
+    c.num_rows = r->num_rows;
+    for (i = 0; i < num_points(&c); i++)
+        get_target(&c, i, r->width, r->height, &target_x[i], &target_y[i]);
+
+    s->bad = (bool*)calloc(r->num_clicks + 1, sizeof(bool));
+    for (k = 0; k < REFIT; k++)
+    {
+        if (!fit_reference(s, target_x, target_y))
+            return false;
+
+        s->num_bad = 0;
+        for (i = 0; i < r->num_clicks; i++)
+        {
+            double x, y;
+
+            reference_click(s, target_x[r->target[i]], target_y[r->target[i]], &x, &y);
+            s->bad[i] = (hypot(r->x[i] - x, r->y[i] - y) > tolerance);
+            if (s->bad[i])
+                s->num_bad++;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * distance (RMS, in pixels) between the targets and where a press on them
+ * would end up with the new calibration in place of the old one
+ */
+static double
+calibration_error (struct Session *s,
+                   struct Calib   *c,
+                   XYinfo          new_axys,
+                   bool            swap_xy)
+{
+    struct Recording *r = s->rec;
+    double sum = 0;
+    int i;
+
+    for (i = 0; i < num_points(c); i++)
+    {
+        double tx, ty, cx, cy, x, y;
+
+        get_target(c, i, r->width, r->height, &tx, &ty);
+        reference_click(s, tx, ty, &cx, &cy);
+        recalibrate(c, &new_axys, swap_xy, r->width, r->height, cx, cy, &x, &y);
+        sum += (x - tx) * (x - tx) + (y - ty) * (y - ty);
+    }
+
+    return sqrt(sum / num_points(c));
+}
+
+/*
+ * replay a session with the thresholds of 'res'
+ *
+ * Only the clicks on the target the calibrator asks for are given to it:
+ * clicks the user made on other targets (because the original run accepted
+ * or rejected differently) would not have happened.
+ */
+static void
+replay_session (struct Session *s,
+                struct Result  *res)
+{
+    struct Recording *r = s->rec;
+    struct Calib c;
+    XYinfo new_axys;
+    bool swap_xy;
+    int i;
+
+    memset(&c, 0, sizeof(c));
+    c.old_axys = r->old_axys;
+    c.num_cols = r->num_cols;
+    c.num_rows = r->num_rows;
+    c.threshold_misclick = res->threshold_misclick;
+    c.threshold_doubleclick = res->threshold_doubleclick;
+    reset(&c);
+
+    for (i = 0; i < r->num_clicks && c.num_clicks < num_points(&c); i++)
+    {
+        if (r->target[i] != grid_point(&c, c.num_clicks))
+            continue;
+
+        res->clicks++;
+        if (s->bad[i])
+            res->bad++;
+        if (add_click(&c, r->x[i], r->y[i]))
+        {
+            if (s->bad[i])
+                res->bad_accepted++;
+        }
+        else
+        {
+            res->rejected++;
+            if (!s->bad[i])
+                res->good_rejected++;
+        }
+    }
+
+    if (finish(&c, r->width, r->height, &new_axys, &swap_xy))
+    {
+        res->finished++;
+        res->error += calibration_error(s, &c, new_axys, swap_xy);
+    }
+}
+
+static void*
+worker (void *data)
+{
+    struct Sweep *sweep = (struct Sweep*)data;
+
+    for (;;)
+    {
+        struct Result *res;
+        int i;
+
+        pthread_mutex_lock(&sweep->lock);
+        i = sweep->next++;
+        pthread_mutex_unlock(&sweep->lock);
+        if (i >= sweep->num_results)
+            break;
+
+        res = &sweep->results[i];
+        for (i = 0; i < sweep->num_sessions; i++)
+            replay_session(&sweep->sessions[i], res);
+        if (res->finished > 0)
+            res->error /= res->finished;
+    }
+
+    return NULL;
+}
+
+/* parse <from>[:<to>[:<step>]] */
+static bool
+get_range (const char *arg,
+           int        *from,
+           int        *to,
+           int        *step)
+{
+    int n = sscanf(arg, "%d:%d:%d", from, to, step);
+
+    if (n < 1)
+        return false;
+    if (n < 2)
+        *to = *from;
+    if (n < 3)
+        *step = 1;
+    return (*from >= 0 && *to >= *from && *step > 0);
+}
+
+static double
+percentage (int part,
+            int total)
+{
+    return total > 0 ? 100.0 * part / total : 0;
+}
+
+static void
+usage (char *cmd)
+{
+    fprintf(stderr, "Usage: %s [-h|--help] [--misclick <from>[:<to>[:<step>]]] [--doubleclick <from>[:<to>[:<step>]]] [--tolerance <nr of pixels>] [--threads <nr>] <recording> ...\n", cmd);
+    fprintf(stderr, "\t-h, --help: print this help message\n");
+    fprintf(stderr, "\t--misclick: the mis-click thresholds to try (default: 0:30:5)\n");
+    fprintf(stderr, "\t--doubleclick: the double-click thresholds to try (default: 7)\n");
+    fprintf(stderr, "\t--tolerance: distance from the reference beyond which a click counts as bad (default: 10 pixels)\n");
+    fprintf(stderr, "\t--threads: nr of worker threads (default: nr of processors)\n");
+    fprintf(stderr, "The recordings are made with xinput_calibrator --record <file>\n");
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    struct Sweep sweep;
+    pthread_t *threads;
+    int started = 0;
+    const char **files;
+    int num_files = 0;
+    int mis_from = 0, mis_to = 30, mis_step = 5;
+    int dbl_from = 7, dbl_to = 7, dbl_step = 1;
+    double tolerance = 10;
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int total_clicks = 0, total_bad = 0;
+    int i, m, d;
+
+    memset(&sweep, 0, sizeof(sweep));
+    sweep.sessions = (struct Session*)calloc(argc, sizeof(struct Session));
+    files = (const char**)calloc(argc, sizeof(const char*));
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp("-h", argv[i]) == 0 || strcmp("--help", argv[i]) == 0) {
+            usage(argv[0]);
+            return 0;
+        } else if (strcmp("--misclick", argv[i]) == 0) {
+            if (argc <= i+1 || !get_range(argv[++i], &mis_from, &mis_to, &mis_step)) {
+                fprintf(stderr, "Error: --misclick needs a range of thresholds as <from>[:<to>[:<step>]]\n\n");
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp("--doubleclick", argv[i]) == 0) {
+            if (argc <= i+1 || !get_range(argv[++i], &dbl_from, &dbl_to, &dbl_step)) {
+                fprintf(stderr, "Error: --doubleclick needs a range of thresholds as <from>[:<to>[:<step>]]\n\n");
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp("--tolerance", argv[i]) == 0) {
+            if (argc <= i+1) {
+                fprintf(stderr, "Error: --tolerance needs a number (the pixel distance) as argument.\n\n");
+                usage(argv[0]);
+                return 1;
+            }
+            tolerance = atof(argv[++i]);
+        } else if (strcmp("--threads", argv[i]) == 0) {
+            if (argc <= i+1) {
+                fprintf(stderr, "Error: --threads needs a number (of worker threads) as argument.\n\n");
+                usage(argv[0]);
+                return 1;
+            }
+            num_threads = atoi(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            files[num_files++] = argv[i];
+        } else {
+            fprintf(stderr, "Unknown option: %s\n\n", argv[i]);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    /* the recordings, with the options given after them too */
+    for (i = 0; i < num_files; i++)
+    {
+        struct Session *s = &sweep.sessions[sweep.num_sessions];
+
+        s->rec = read_recording(files[i]);
+        if (s->rec == NULL) {
+            fprintf(stderr, "Error: '%s' is not a valid recording\n", files[i]);
+            return 1;
+        }
+        if (!prepare_session(s, tolerance)) {
+            fprintf(stderr, "Warning: '%s' has too few clicks, skipping it\n", files[i]);
+            free_recording(s->rec);
+            free(s->bad);
+            continue;
+        }
+        total_clicks += s->rec->num_clicks;
+        total_bad += s->num_bad;
+        sweep.num_sessions++;
+    }
+    free(files);
+    if (sweep.num_sessions == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (num_threads < 1)
+        num_threads = 1;
+
+    /* all combinations of the thresholds */
+    sweep.num_results = ((mis_to - mis_from) / mis_step + 1) * ((dbl_to - dbl_from) / dbl_step + 1);
+    sweep.results = (struct Result*)calloc(sweep.num_results, sizeof(struct Result));
+    i = 0;
+    for (m = mis_from; m <= mis_to; m += mis_step)
+        for (d = dbl_from; d <= dbl_to; d += dbl_step)
+        {
+            sweep.results[i].threshold_misclick = m;
+            sweep.results[i].threshold_doubleclick = d;
+            i++;
+        }
+
+    pthread_mutex_init(&sweep.lock, NULL);
+    threads = (pthread_t*)calloc(num_threads, sizeof(pthread_t));
+    if (threads != NULL)
+        while (started < num_threads &&
+               pthread_create(&threads[started], NULL, worker, &sweep) == 0)
+            started++;
+    /* the workers take the settings from a queue: without them, take all */
+    if (started == 0)
+        worker(&sweep);
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&sweep.lock);
+
+    printf("%d sessions, %d clicks, %d bad (further than %g pixels from the reference)\n\n",
+           sweep.num_sessions, total_clicks, total_bad, tolerance);
+    /* good rejected: of the good clicks, bad accepted: of the bad ones */
+    printf("misclick doubleclick  rejected  good rejected  bad accepted  finished  error (px)\n");
+    for (i = 0; i < sweep.num_results; i++)
+    {
+        struct Result *res = &sweep.results[i];
+
+        printf("%8d %11d %8.1f%% %13.1f%% %12.1f%% %5d/%-3d %10.2f\n",
+               res->threshold_misclick, res->threshold_doubleclick,
+               percentage(res->rejected, res->clicks),
+               percentage(res->good_rejected, res->clicks - res->bad),
+               percentage(res->bad_accepted, res->bad),
+               res->finished, sweep.num_sessions, res->error);
+    }
+
+    for (i = 0; i < sweep.num_sessions; i++)
+    {
+        free_recording(sweep.sessions[i].rec);
+        free(sweep.sessions[i].bad);
+    }
+    free(sweep.sessions);
+    free(sweep.results);
+    free(threads);
+
+    return 0;
+}
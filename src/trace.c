@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "trace.h"
+
+/* how to print an event: the text (if it has one) comes first */
+struct TraceFormat
+{
+    bool text;
+    const char *format;
+};
+
+static const struct TraceFormat formats[NUM_TRACE_EVENTS] =
+{
+    { false, "XInputExtension version is %.0f.%.0f" },
+    { false, "Skipping virtual master devices and devices without axis valuators." },
+    { true,  "Skipping device '%s' id=%.0f, does not report Absolute events." },
+    { true,  "Skipping device '%s' id=%.0f, does not have two calibratable axes." },
+    { true,  "Driver calibration of '%s': %.0f, %.0f, %.0f, %.0f" },
+    { true,  "Driver swap and inversion of '%s': swap=%.0f, invert=%.0f %.0f" },
+    { true,  "Display: %s" },
+    { true,  "Faking device: %s" },
+    { true,  "Reading clicks from %s (live: %.0f)" },
+    { true,  "Selected device: %s id=%.0f, of %.0f found" },
+    { false, "Setting precalibration: %.0f, %.0f, %.0f, %.0f" },
+    { true,  "Candidate device: %s id=%.0f" },
+    { false, "Current matrix, row %.0f: %f %f %f" },
+    { false, "%.2f pixels per mm, thresholds: mis-click %.0f, double-click %.0f" },
+    { false, "gtk_main entered" },
+    { false, "gtk_main returned" },
+    { false, "Click at %.0f, %.0f: accepted=%.0f, %.0f clicks" },
+    { false, "Press at %.0f, %.0f" },
+    { false, "Press shown after %.2f ms by the marker" },
+    { false, "Press shown after %.2f ms by the full redraw" },
+    { false, "Seam of tiles %.0f and %.0f: %.1f pixels apart, joined (%.1f left at its ends)" },
+    { false, "Calibration failed" }
+};
+
+static struct TraceRecord ring[TRACE_RECORDS];
+/* nr of records ever written; the next goes to ring[num_records % TRACE_RECORDS] */
+static unsigned long num_records = 0;
+
+static const char *trace_file = NULL;
+static bool trace_echo = false;
+static double start_time = -1;
+
+static volatile sig_atomic_t dump_requested = 0;
+
+static double
+now (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+on_dump_signal (int sig)
+{
+    dump_requested = 1;
+}
+
+/* with 'text', not the record's own (truncated) copy */
+static void
+print_record (FILE                     *f,
+              const struct TraceRecord *r,
+              const char               *text)
+{
+    const struct TraceFormat *format = &formats[r->event];
+
+    if (format->text)
+        fprintf(f, format->format, text, r->arg[0], r->arg[1], r->arg[2], r->arg[3]);
+    else
+        fprintf(f, format->format, r->arg[0], r->arg[1], r->arg[2], r->arg[3]);
+    fputc('\n', f);
+}
+
+void
+trace_init (const char *dump_file,
+            bool        echo)
+{
+    if (start_time < 0)
+        start_time = now();
+    trace_echo = echo;
+
+    /* restarted, so that the signal does not interrupt a read or wait of
+     * the program, and kept for the next dump */
+    if (dump_file != NULL && trace_file == NULL)
+    {
+        struct sigaction action;
+
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = on_dump_signal;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &action, NULL);
+    }
+    if (dump_file != NULL)
+        trace_file = dump_file;
+}
+
+void
+trace_point (int         event,
+             const char *text,
+             double      a,
+             double      b,
+             double      c,
+             double      d)
+{
+    struct TraceRecord *r = &ring[num_records % TRACE_RECORDS];
+
+    r->time = now() - start_time;
+    r->event = event;
+    r->arg[0] = a;
+    r->arg[1] = b;
+    r->arg[2] = c;
+    r->arg[3] = d;
+    r->text[0] = '\0';
+    if (text != NULL)
+        strncat(r->text, text, TRACE_TEXT_SIZE - 1);
+    num_records++;
+
+    if (trace_echo)
+    {
+        printf("DEBUG: ");
+        print_record(stdout, r, text != NULL ? text : "");
+    }
+    if (dump_requested)
+        trace_poll();
+}
+
+bool
+trace_dump (void)
+{
+    unsigned long first = 0;
+    unsigned long i;
+    FILE *f;
+
+    if (trace_file == NULL)
+        return false;
+    f = fopen(trace_file, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Error: unable to write the trace to '%s'\n", trace_file);
+        return false;
+    }
+
+    if (num_records > TRACE_RECORDS)
+        first = num_records - TRACE_RECORDS;
+    fprintf(f, "# xinput_calibrator trace: %lu events, the last %lu of them\n",
+            num_records, num_records - first);
+    for (i = first; i < num_records; i++)
+    {
+        const struct TraceRecord *r = &ring[i % TRACE_RECORDS];
+
+        fprintf(f, "%12.6f ", r->time);
+        print_record(f, r, r->text);
+    }
+
+    fclose(f);
+    return true;
+}
+
+void
+trace_poll (void)
+{
+    if (!dump_requested)
+        return;
+    dump_requested = 0;
+    if (trace_dump())
+        fprintf(stderr, "Trace dumped to '%s'\n", trace_file);
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _trace_h
+#define _trace_h
+
+#include "calibrator.h"
+
+/*
+ * Trace log: the trace points record an event and its arguments into a ring
+ * of TRACE_RECORDS fixed-size records, in binary; they are only formatted
+ * when the ring is dumped to the trace file (--trace), on failure or on
+ * SIGUSR1, or echoed with --verbose (with their text in full). Configure
+ * with --disable-trace to compile the trace points out.
+ *
+ * The ring is a global of the xinput_calibrator program, not of the
+ * library (whose sessions must not share state); the library's trace
+ * points come in through calib_set_trace(). It is not locked: trace from
+ * the main thread only.
+ */
+#define TRACE_RECORDS   1024
+#define TRACE_TEXT_SIZE 24
+
+/* the events, see the formats in trace.c */
+enum TraceEvent
+{
+    /* those of the library first, as many and in the same order (see
+     * enum CalibTraceEvent) */
+    TRACE_XI_VERSION = CALIB_TRACE_XI_VERSION,
+    TRACE_SKIP_MASTERS,
+    TRACE_SKIP_RELATIVE,
+    TRACE_SKIP_AXES,
+    TRACE_DRIVER_CALIB,
+    TRACE_DRIVER_SWAP,
+    TRACE_DISPLAY,          /* display name */
+    TRACE_FAKE_DEVICE,      /* device name */
+    TRACE_EVDEV,            /* device or recording; live */
+    TRACE_SELECTED,         /* device name; id, nr found */
+    TRACE_PRECALIB,         /* min x, max x, min y, max y */
+    TRACE_CANDIDATE,        /* device name; id */
+    TRACE_MATRIX_ROW,       /* row; its 3 elements */
+    TRACE_RESOLUTION,       /* px per mm, mis-click, double-click threshold */
+    TRACE_GTK_MAIN,
+    TRACE_GTK_MAIN_DONE,
+    TRACE_CLICK,            /* x, y, accepted, nr of clicks */
+    TRACE_PRESS,            /* x, y */
+    TRACE_PRESS_MARKER,     /* ms since the press */
+    TRACE_PRESS_REDRAW,     /* ms since the press */
+    TRACE_SEAM,             /* tile, tile, pixels apart, left at the ends */
+    TRACE_FAILED,
+    NUM_TRACE_EVENTS
+};
+
+/* one trace point, stored as is */
+struct TraceRecord
+{
+    double time;            /* seconds, since the first trace_init() */
+    int event;
+    double arg[4];
+    char text[TRACE_TEXT_SIZE];
+};
+
+/*
+ * Where to dump the ring to (NULL: nowhere) and whether to echo the trace
+ * points as they come; can be called again, the ring is kept.
+ */
+void trace_init (const char *dump_file,
+                 bool        echo);
+void trace_point(int         event,
+                 const char *text,
+                 double      a,
+                 double      b,
+                 double      c,
+                 double      d);
+/* dump the ring now, if there is a trace file */
+bool trace_dump (void);
+/* dump the ring if SIGUSR1 asked for it */
+void trace_poll (void);
+
+#ifndef NO_TRACE
+#define TRACE(event, a, b, c, d)            trace_point((event), NULL, (a), (b), (c), (d))
+#define TRACE_TEXT(event, text, a, b, c, d) trace_point((event), (text), (a), (b), (c), (d))
+#else
+#define TRACE(event, a, b, c, d)            ((void)0)
+#define TRACE_TEXT(event, text, a, b, c, d) ((void)0)
+#endif
+
+#endif /* _trace_h */
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <math.h>
+
+#include "verify.h"
+
+/* regions of the display, 3x3, row by row */
+static const char *region_name[9] = {
+    "top left",    "top",    "top right",
+    "left",        "centre", "right",
+    "bottom left", "bottom", "bottom right"
+};
+
+void
+verify_start (struct Verification *v,
+              int                  width,
+              int                  height)
+{
+    int i;
+
+    /* the centres of a VERIFY_GRID x VERIFY_GRID partition: closer to the
+     * edges than the points of the calibration */
+    for (i = 0; i < VERIFY_POINTS; i++)
+    {
+        v->target_x[i] = (i % VERIFY_GRID + 0.5) * width / VERIFY_GRID;
+        v->target_y[i] = (i / VERIFY_GRID + 0.5) * height / VERIFY_GRID;
+    }
+    v->num_pressed = 0;
+    v->max_error = 0;
+    v->mean_error = 0;
+    v->worst_point = -1;
+    v->worst_region = NULL;
+}
+
+/* error at grid node col, row (clamped to the grid) */
+static double
+node_error (const struct Verification *v,
+            int                        col,
+            int                        row)
+{
+    int i;
+
+    col = (col < 0) ? 0 : (col >= VERIFY_GRID) ? VERIFY_GRID - 1 : col;
+    row = (row < 0) ? 0 : (row >= VERIFY_GRID) ? VERIFY_GRID - 1 : row;
+    i = row * VERIFY_GRID + col;
+
+    return sqrt(v->error_x[i] * v->error_x[i] + v->error_y[i] * v->error_y[i]);
+}
+
+/* the error magnitude at a position in grid units, bilinearly */
+static double
+interpolate_error (const struct Verification *v,
+                   double                     gx,
+                   double                     gy)
+{
+    int col = (int)floor(gx);
+    int row = (int)floor(gy);
+    double fx = gx - col;
+    double fy = gy - row;
+
+    return (1 - fy) * ((1 - fx) * node_error(v, col, row) + fx * node_error(v, col + 1, row)) +
+           fy       * ((1 - fx) * node_error(v, col, row + 1) + fx * node_error(v, col + 1, row + 1));
+}
+
+static void
+summarize (struct Verification *v,
+           int                  width,
+           int                  height)
+{
+    double region_sum[9];
+    int region_count[9];
+    double worst_mean = -1;
+    double sum = 0;
+    int i, r;
+
+    for (r = 0; r < 9; r++)
+    {
+        region_sum[r] = 0;
+        region_count[r] = 0;
+    }
+
+    for (i = 0; i < VERIFY_POINTS; i++)
+    {
+        double e = node_error(v, i % VERIFY_GRID, i / VERIFY_GRID);
+
+        sum += e;
+        if (e > v->max_error || v->worst_point < 0)
+        {
+            v->max_error = e;
+            v->worst_point = i;
+        }
+
+        r = (int)(3 * v->target_y[i] / height) * 3 + (int)(3 * v->target_x[i] / width);
+        region_sum[r] += e;
+        region_count[r]++;
+    }
+    v->mean_error = sum / VERIFY_POINTS;
+
+    for (r = 0; r < 9; r++)
+        if (region_count[r] > 0 && region_sum[r] / region_count[r] > worst_mean)
+        {
+            worst_mean = region_sum[r] / region_count[r];
+            v->worst_region = region_name[r];
+        }
+
+    /* the heatmap: the cell centres in grid units (the nodes are at the
+     * centres of the grid's cells) */
+    for (i = 0; i < VERIFY_HEAT * VERIFY_HEAT; i++)
+    {
+        double gx = ((i % VERIFY_HEAT) + 0.5) * VERIFY_GRID / VERIFY_HEAT - 0.5;
+        double gy = ((i / VERIFY_HEAT) + 0.5) * VERIFY_GRID / VERIFY_HEAT - 0.5;
+
+        v->heat[i] = (float)interpolate_error(v, gx, gy);
+    }
+}
+
+bool
+verify_press (struct Verification *v,
+              int                  width,
+              int                  height,
+              double               x,
+              double               y)
+{
+    int i = v->num_pressed;
+
+    if (i >= VERIFY_POINTS)
+        return true;
+
+    v->error_x[i] = x - v->target_x[i];
+    v->error_y[i] = y - v->target_y[i];
+    v->num_pressed++;
+
+    if (v->num_pressed < VERIFY_POINTS)
+        return false;
+
+    summarize(v, width, height);
+    return true;
+}
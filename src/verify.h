@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _verify_h
+#define _verify_h
+
+#include "calibrator.h"
+
+/*
+ * Verification of a calibration (--verify): the points of a denser grid,
+ * over the whole display, are pressed once more and mapped with the new
+ * calibration. Their error vectors give the accuracy across the screen;
+ * the magnitude is interpolated (bilinearly) onto VERIFY_HEAT x VERIFY_HEAT
+ * cells once, for the heatmap.
+ */
+#define VERIFY_GRID   5
+#define VERIFY_POINTS (VERIFY_GRID * VERIFY_GRID)
+#define VERIFY_HEAT   24
+
+/* error at which the heatmap is fully red (pixels) */
+#define VERIFY_FULL_SCALE 10
+
+struct Verification
+{
+    /* the points, row by row, and the nr pressed so far */
+    double target_x[VERIFY_POINTS], target_y[VERIFY_POINTS];
+    int num_pressed;
+
+    /* error vector of each pressed point (pixels) */
+    double error_x[VERIFY_POINTS], error_y[VERIFY_POINTS];
+
+    /* summary, once all are pressed: largest and mean error, the point
+     * with the largest one and the region (of 3x3) with the largest mean */
+    double max_error;
+    double mean_error;
+    int worst_point;
+    const char *worst_region;
+
+    /* error of each heatmap cell, row by row */
+    float heat[VERIFY_HEAT * VERIFY_HEAT];
+};
+
+/* the points for a width x height display, none pressed */
+void verify_start (struct Verification *v,
+                   int                  width,
+                   int                  height);
+
+/*
+ * the current point was pressed, ending up at x, y with the new
+ * calibration; returns true once all are pressed (and summarized)
+ */
+bool verify_press (struct Verification *v,
+                   int                  width,
+                   int                  height,
+                   double               x,
+                   double               y);
+
+#endif /* _verify_h */
@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "wall.h"
+#include "trace.h"
+
+/* the solve of one tile */
+struct TileJob
+{
+    struct Wall *wall;
+    int t;
+    int screen_width;
+    int screen_height;
+    bool valid;
+};
+
+/* midpoints of the device's edges (normalized): u = 0, u = 1, v = 0, v = 1 */
+static const double edge_u[4] = {0, 1, 0.5, 0.5};
+static const double edge_v[4] = {0.5, 0.5, 0, 1};
+
+/* points along a seam at which the two tiles are compared */
+#define SEAM_SAMPLES 5
+
+struct Wall*
+new_wall (struct Calib *c)
+{
+    static const float identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    struct Wall *wall = (struct Wall*)calloc(1, sizeof(struct Wall));
+    int t;
+
+    if (wall == NULL)
+        return NULL;
+    wall->cols = c->wall_cols;
+    wall->rows = c->wall_rows;
+    wall->num_tiles = c->wall_cols * c->wall_rows;
+    wall->c = c;
+
+    for (t = 0; t < wall->num_tiles; t++)
+    {
+        struct Calib *tile = (struct Calib*)malloc(sizeof(struct Calib));
+
+        if (tile == NULL)
+        {
+            free_wall(wall);
+            return NULL;
+        }
+        wall->tile[t] = tile;
+
+        /* the settings of the wall, the overlay still to be found (unless
+         * there is nothing to choose from) */
+        *tile = *c;
+        tile->device_name = NULL;
+        tile->num_candidates = 0;
+        tile->more_displays = NULL;
+        tile->next = NULL;
+        tile->wall_cols = tile->wall_rows = 0;
+        tile->use_matrix = true;
+        memcpy(tile->old_matrix, identity, sizeof(identity));
+        tile->count_clicks = tile->count_doubleclicks = 0;
+        tile->count_misclicks = tile->count_resets = 0;
+        if (c->num_candidates > 0)
+            tile->device_id = -1;
+    }
+
+    return wall;
+}
+
+void
+free_wall (struct Wall *wall)
+{
+    int t;
+
+    if (wall == NULL)
+        return;
+    for (t = 0; t < wall->num_tiles; t++)
+        if (wall->tile[t] != NULL)
+        {
+            free(wall->tile[t]->device_name);
+            free(wall->tile[t]);
+        }
+    free(wall);
+}
+
+void
+layout_wall (struct Wall *wall,
+             int          x,
+             int          y,
+             int          width,
+             int          height)
+{
+    int t, i;
+
+    for (t = 0; t < wall->num_tiles; t++)
+    {
+        struct Calib *tile = wall->tile[t];
+        int col = t % wall->cols;
+        int row = t / wall->cols;
+
+        /* neighbours compute their common seam the same way */
+        wall->tile_x[t] = x + col * width / wall->cols;
+        wall->tile_y[t] = y + row * height / wall->rows;
+        wall->tile_width[t] = x + (col + 1) * width / wall->cols - wall->tile_x[t];
+        wall->tile_height[t] = y + (row + 1) * height / wall->rows - wall->tile_y[t];
+
+        for (i = 0; i < num_points(tile); i++)
+        {
+            get_target(tile, i, wall->tile_width[t], wall->tile_height[t],
+                       &wall->target_x[t][i], &wall->target_y[t][i]);
+            wall->target_x[t][i] += wall->tile_x[t];
+            wall->target_y[t][i] += wall->tile_y[t];
+        }
+        reset(tile);
+    }
+}
+
+static void*
+solve_tile (void *data)
+{
+    struct TileJob *job = (struct TileJob*)data;
+    struct Wall *wall = job->wall;
+
+    job->valid = finish_matrix(wall->tile[job->t], wall->target_x[job->t], wall->target_y[job->t],
+                               job->screen_width, job->screen_height);
+    return NULL;
+}
+
+/* where a tile's matrix puts a device position, along 'axis', in pixels */
+static double
+map_position (const float *m,
+              int          axis,
+              double       u,
+              double       v,
+              int          size)
+{
+    return (m[3*axis] * u + m[3*axis + 1] * v + m[3*axis + 2]) * size;
+}
+
+/* the device edge of a tile facing its neighbour along 'axis' (after it,
+ * or before it), and where it is */
+static int
+facing_edge (const float *m,
+             int          axis,
+             bool         after,
+             int          size,
+             double      *position)
+{
+    int e, best = 0;
+
+    for (e = 0; e < 4; e++)
+    {
+        double p = map_position(m, axis, edge_u[e], edge_v[e], size);
+
+        if (e == 0 || (after ? p > *position : p < *position))
+        {
+            best = e;
+            *position = p;
+        }
+    }
+    return best;
+}
+
+/*
+ * the ends of edge 'e' of a tile's device: where they are along 'axis' (in
+ * pixels), and along the seam (normalized)
+ */
+static void
+edge_ends (const float *m,
+           int          axis,
+           int          e,
+           int          size,
+           double      *p,
+           double      *q)
+{
+    int k;
+
+    for (k = 0; k < 2; k++)
+    {
+        double u = (e < 2) ? edge_u[e] : k;
+        double v = (e < 2) ? k : edge_v[e];
+
+        p[k] = map_position(m, axis, u, v, size);
+        q[k] = map_position(m, 1 - axis, u, v, 1);
+    }
+}
+
+/* where an edge is along 'axis' at 's' along the seam */
+static double
+along_edge (const double *p,
+            const double *q,
+            double        s)
+{
+    return p[0] + (p[1] - p[0]) * (s - q[0]) / (q[1] - q[0]);
+}
+
+/*
+ * move edge 'e' of a tile's device by 'delta' (normalized) along 'axis',
+ * keeping the opposite edge in place: adds delta times the device
+ * coordinate that is 1 at the edge and 0 at the opposite one
+ */
+static void
+stretch (float  *m,
+         int     axis,
+         int     e,
+         double  delta)
+{
+    float *row = m + 3*axis;
+
+    switch (e)
+    {
+    case 0:
+        row[0] -= delta;
+        row[2] += delta;
+        break;
+    case 1:
+        row[0] += delta;
+        break;
+    case 2:
+        row[1] -= delta;
+        row[2] += delta;
+        break;
+    case 3:
+        row[1] += delta;
+        break;
+    }
+}
+
+/*
+ * Join the seam between tile 'a' and the next one 'b' along 'axis': the
+ * gap between their edges is sampled along the part of the seam both
+ * cover, and both edges are moved by half its mean (the least-squares
+ * shift). Only the offset is matched: a matrix can not turn one edge of a
+ * tile without moving its far edge, so if the two fits see the seam at
+ * different angles, its ends stay apart by what is left (traced).
+ */
+static void
+join_seam (struct Wall *wall,
+           int          a,
+           int          b,
+           int          axis,
+           int          size,
+           float        (*matrix)[9])
+{
+    float *ma = wall->tile[a]->new_matrix;
+    float *mb = wall->tile[b]->new_matrix;
+    double pa[2], qa[2], pb[2], qb[2];
+    double lo, hi, mid;
+    double gap[SEAM_SAMPLES];
+    double mean = 0, worst = 0, left;
+    int ea, eb, i;
+
+    /* projective matrices are left alone */
+    if (ma[6] != 0 || ma[7] != 0 || mb[6] != 0 || mb[7] != 0)
+        return;
+
+    ea = facing_edge(ma, axis, true, size, &mid);
+    eb = facing_edge(mb, axis, false, size, &mid);
+    edge_ends(ma, axis, ea, size, pa, qa);
+    edge_ends(mb, axis, eb, size, pb, qb);
+
+    /* the part of the seam along both edges */
+    lo = (qa[0] < qa[1]) ? qa[0] : qa[1];
+    hi = (qa[0] < qa[1]) ? qa[1] : qa[0];
+    if (qb[0] > lo && qb[1] > lo)
+        lo = (qb[0] < qb[1]) ? qb[0] : qb[1];
+    if (qb[0] < hi && qb[1] < hi)
+        hi = (qb[0] < qb[1]) ? qb[1] : qb[0];
+    if (qa[0] == qa[1] || qb[0] == qb[1] || lo >= hi)
+    {
+        fprintf(stderr, "Warning: tiles %d and %d do not meet at their seam, not joined\n",
+                a + 1, b + 1);
+        return;
+    }
+
+    for (i = 0; i < SEAM_SAMPLES; i++)
+    {
+        double s = lo + (hi - lo) * i / (SEAM_SAMPLES - 1);
+
+        gap[i] = along_edge(pb, qb, s) - along_edge(pa, qa, s);
+        mean += gap[i] / SEAM_SAMPLES;
+        if (fabs(gap[i]) > fabs(worst))
+            worst = gap[i];
+    }
+
+    if (fabs(worst) > WALL_SEAM_TOLERANCE)
+    {
+        fprintf(stderr, "Warning: tiles %d and %d are up to %.1f pixels apart at their seam (%s), not joined\n",
+                a + 1, b + 1, fabs(worst), (worst > 0) ? "gap" : "overlap");
+        return;
+    }
+    /* the gap is linear along the seam: what is left is largest at its ends */
+    left = fabs(gap[0] - mean);
+    if (fabs(gap[SEAM_SAMPLES - 1] - mean) > left)
+        left = fabs(gap[SEAM_SAMPLES - 1] - mean);
+    TRACE(TRACE_SEAM, a + 1, b + 1, fabs(mean), left);
+
+    /* to the matrices of after the solve, the stretches add up */
+    stretch(matrix[a], axis, ea, mean / 2 / size);
+    stretch(matrix[b], axis, eb, -mean / 2 / size);
+}
+
+bool
+solve_wall (struct Wall *wall,
+            int          screen_width,
+            int          screen_height)
+{
+    struct TileJob jobs[MAX_TILES];
+    float joined[MAX_TILES][9];
+    bool success = true;
+    int t, col, row;
+#ifdef HAVE_PTHREAD_H
+    pthread_t threads[MAX_TILES];
+    int started = 0;
+#endif
+
+    for (t = 0; t < wall->num_tiles; t++)
+    {
+        jobs[t].wall = wall;
+        jobs[t].t = t;
+        jobs[t].screen_width = screen_width;
+        jobs[t].screen_height = screen_height;
+        jobs[t].valid = false;
+    }
+
+    /* the tiles are independent: a thread each */
+#ifdef HAVE_PTHREAD_H
+    while (started < wall->num_tiles &&
+           pthread_create(&threads[started], NULL, solve_tile, &jobs[started]) == 0)
+        started++;
+    for (t = started; t < wall->num_tiles; t++)
+        solve_tile(&jobs[t]);
+    for (t = 0; t < started; t++)
+        pthread_join(threads[t], NULL);
+#else
+    for (t = 0; t < wall->num_tiles; t++)
+        solve_tile(&jobs[t]);
+#endif
+
+    for (t = 0; t < wall->num_tiles; t++)
+        if (!jobs[t].valid)
+        {
+            fprintf(stderr, "Error: tile %d not calibrated\n", t + 1);
+            success = false;
+        }
+    if (!success)
+        return false;
+
+    for (t = 0; t < wall->num_tiles; t++)
+        memcpy(joined[t], wall->tile[t]->new_matrix, sizeof(joined[t]));
+
+    for (row = 0; row < wall->rows; row++)
+        for (col = 0; col < wall->cols; col++)
+        {
+            t = row * wall->cols + col;
+            if (col + 1 < wall->cols)
+                join_seam(wall, t, t + 1, 0, screen_width, joined);
+            if (row + 1 < wall->rows)
+                join_seam(wall, t, t + wall->cols, 1, screen_height, joined);
+        }
+
+    for (t = 0; t < wall->num_tiles; t++)
+        memcpy(wall->tile[t]->new_matrix, joined[t], sizeof(joined[t]));
+
+    return true;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _wall_h
+#define _wall_h
+
+#include "calibrator.h"
+
+/*
+ * Video walls (--wall): one X screen tiled with 'cols' x 'rows' displays,
+ * each behind a touch overlay of its own. In one session the points of
+ * each tile are pressed with its overlay (the first one to press them),
+ * and each tile is calibrated with a struct Calib of its own, to a
+ * coordinate transformation matrix relative to the whole screen.
+ *
+ * The tiles are solved on worker threads (if available). Then the seams
+ * are joined: the edges of two neighbouring overlays meet at their seam,
+ * so the two fits give two estimates of where it is. If they are within
+ * WALL_SEAM_TOLERANCE pixels all along it, both tiles are stretched to
+ * the mean (each keeping its far edge in place), so nothing jumps or is
+ * lost crossing the seam; further apart, it is reported and left as is.
+ * Only the offset of the seam is matched, not its angle.
+ */
+#define MAX_TILES MAX_CANDIDATES
+#define WALL_SEAM_TOLERANCE 20
+
+struct Wall
+{
+    int cols;
+    int rows;
+    int num_tiles;
+
+    /* the calibrator of the wall, with the overlays as candidates */
+    struct Calib *c;
+
+    /* the tiles, row by row, their regions (the seams shared by
+     * neighbours) and points, in root coordinates */
+    struct Calib *tile[MAX_TILES];
+    int tile_x[MAX_TILES], tile_y[MAX_TILES];
+    int tile_width[MAX_TILES], tile_height[MAX_TILES];
+    double target_x[MAX_TILES][MAX_POINTS], target_y[MAX_TILES][MAX_POINTS];
+};
+
+/* a wall of c->wall_cols x c->wall_rows tiles, not laid out yet */
+struct Wall* new_wall    (struct Calib *c);
+void         free_wall   (struct Wall  *wall);
+
+/* the tiles over a width x height region at x, y; no clicks yet */
+void         layout_wall (struct Wall  *wall,
+                          int           x,
+                          int           y,
+                          int           width,
+                          int           height);
+
+/*
+ * solve all tiles (the new_matrix of each) and join the seams; returns
+ * false if a tile does not give a calibration
+ */
+bool         solve_wall  (struct Wall  *wall,
+                          int           screen_width,
+                          int           screen_height);
+
+#endif /* _wall_h */
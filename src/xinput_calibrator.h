@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2009 Tias Guns
+ * Copyright (c) 2009 Soren Hauberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _xinput_calibrator_h
+#define _xinput_calibrator_h
+
+/*
+ * Embeddable touchscreen calibration.
+ *
+ * A calibration session holds all of its state, so several can run at the
+ * same time. It does not draw, read input or block: the host shows the
+ * target of calib_session_get_target(), feeds the clicks it gets with
+ * calib_session_click() and the time that passed with calib_session_advance()
+ * (calib_session_timeout() tells how long it can wait in its poll loop),
+ * until the state is no longer CALIB_WAITING.
+ *
+ * Nothing in here exits the process; errors are returned.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* struct to hold min/max info of the X and Y axis */
+typedef struct
+{
+    int x_min;
+    int x_max;
+    int y_min;
+    int y_max;
+} XYinfo;
+
+/* state of a calibration session */
+enum CalibState
+{
+    CALIB_WAITING = 0,  /* waiting for a click on the current target */
+    CALIB_DONE,         /* all targets clicked, the result is available */
+    CALIB_TIMED_OUT,    /* no click within the timeout */
+    CALIB_ABORTED,      /* aborted by the host */
+    CALIB_FAILED        /* clicks did not give a valid calibration */
+};
+
+/* errors of calib_find_device() */
+#define CALIB_ERROR_DISPLAY -1 /* unable to connect to the X server */
+#define CALIB_ERROR_XINPUT  -2 /* X Input extension not available */
+
+struct CalibSession;
+
+/* the trace points of the library, see calib_set_trace() */
+enum CalibTraceEvent
+{
+    CALIB_TRACE_XI_VERSION = 0, /* major, minor */
+    CALIB_TRACE_SKIP_MASTERS,
+    CALIB_TRACE_SKIP_RELATIVE,  /* device name; id */
+    CALIB_TRACE_SKIP_AXES,      /* device name; id */
+    CALIB_TRACE_DRIVER_CALIB,   /* device name; min x, max x, min y, max y */
+    CALIB_TRACE_DRIVER_SWAP,    /* device name; swap, invert x, invert y */
+    NUM_CALIB_TRACE_EVENTS
+};
+
+typedef void (*CalibTraceFunc) (int          event,
+                                const char  *text,
+                                double       a,
+                                double       b,
+                                double       c,
+                                double       d);
+
+/*
+ * where the library reports what it found (the devices it skipped, the
+ * driver's calibration, ...): an event of enum CalibTraceEvent, a text or
+ * NULL and up to four numbers. NULL (the default) reports nothing. Set it
+ * once, before any other call: it is the only setting not of a session.
+ */
+void                 calib_set_trace          (CalibTraceFunc       func);
+
+/*
+ * find a calibratable touchscreen device (using XInput) on the display
+ * (NULL for the default one), see xinput_calibrator --device and --list
+ * ('verbose' is no longer used: the details go to calib_set_trace()).
+ * device_axys is the driver's current calibration (with any inversion
+ * applied, as min > max), or else the range of the axes.
+ * returns the nr of devices found, or a CALIB_ERROR_* value
+ */
+int                  calib_find_device        (const char          *display_name,
+                                               const char          *pre_device,
+                                               int                  verbose,
+                                               int                  list_devices,
+                                               int                 *device_id,
+                                               char               **device_name,
+                                               XYinfo              *device_axys);
+
+/*
+ * all calibratable devices of the display (the first 'max_devices' of
+ * them, the names malloc'ed); returns the nr found, or a CALIB_ERROR_*
+ */
+int                  calib_find_devices       (const char          *display_name,
+                                               int                  max_devices,
+                                               int                 *device_ids,
+                                               char               **device_names,
+                                               XYinfo              *device_axys);
+
+/*
+ * whether the driver swaps the axes and inverts them now (the evdev
+ * properties); returns 1 if the driver has them, 0 otherwise
+ */
+int                  calib_get_driver_state   (const char          *display_name,
+                                               int                  device_id,
+                                               int                 *swap_xy,
+                                               int                 *invert_x,
+                                               int                 *invert_y);
+
+/*
+ * get/set the 'Coordinate Transformation Matrix' property of a device
+ * (row by row); returns 1 on success, 0 if the device does not have it
+ */
+int                  calib_get_matrix         (const char          *display_name,
+                                               int                  device_id,
+                                               float               *matrix);
+int                  calib_set_matrix         (const char          *display_name,
+                                               int                  device_id,
+                                               const float         *matrix);
+
+/* new session for a device with the current calibration 'old_axys' */
+struct CalibSession* calib_session_new        (const XYinfo        *old_axys,
+                                               int                  width,
+                                               int                  height);
+void                 calib_session_free       (struct CalibSession *s);
+
+/* settings, before the first click (returns 0 if invalid) */
+int                  calib_session_set_grid   (struct CalibSession *s,
+                                               int                  cols,
+                                               int                  rows);
+void                 calib_session_set_thresholds (struct CalibSession *s,
+                                               int                  misclick,
+                                               int                  doubleclick);
+void                 calib_session_set_timeout(struct CalibSession *s,
+                                               int                  ms);
+/* resolution of the display, the thresholds are then for a 96 DPI one and
+ * scaled to it */
+void                 calib_session_set_resolution (struct CalibSession *s,
+                                               double               px_per_mm);
+
+/* driving the session */
+int                  calib_session_get_target (struct CalibSession *s,
+                                               double              *x,
+                                               double              *y);
+enum CalibState      calib_session_click      (struct CalibSession *s,
+                                               int                  x,
+                                               int                  y);
+enum CalibState      calib_session_advance    (struct CalibSession *s,
+                                               int                  elapsed_ms);
+int                  calib_session_timeout    (struct CalibSession *s);
+void                 calib_session_abort      (struct CalibSession *s);
+
+/* state, message to show (or NULL) and result */
+enum CalibState      calib_session_state      (struct CalibSession *s);
+const char*          calib_session_message    (struct CalibSession *s);
+int                  calib_session_result     (struct CalibSession *s,
+                                               XYinfo              *new_axys,
+                                               int                 *swap_xy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _xinput_calibrator_h */